@@ -3,32 +3,111 @@
 #include <math.h>
 #include <time.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <omp.h>
 #include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
 #include <iostream>
 #include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <sstream>
+#include <thread>
+#include <unordered_set>
 #include <vector>
 #define CL_HPP_TARGET_OPENCL_VERSION 220
 #define CL_HPP_ENABLE_EXCEPTIONS
 #include <CL/opencl.hpp>
+#define GL_GLEXT_PROTOTYPES
 #include <GL/freeglut.h>
 #include <GL/glx.h>
+#include "langtons_ant_cpu.hpp"
+#include "langtons_ant_memo.hpp"
+#include "langtons_ant_plane.hpp"
 
 // ----------------------------------------------------------------------
 // game variables
 // ----------------------------------------------------------------------
-static int paused = 0;
-static std::vector<cl_char> field_image;
+// 0: running, 1: paused, 2: pause after the current batch
+static std::atomic<int> paused(0);
 static cl_int field_width = 1024;
 static cl_int field_height = 1024;
 static int n_ants = 20;
 static size_t step = 0;
+static int steps_per_frame = 1;  // 0: adaptive
+static bool headless = false;
+static size_t max_steps = 0;  // 0: unlimited
+static const char *output_file = 0;
+static unsigned int seed = 0;  // of the random ants (--seed)
+static bool seed_given = false;
+static std::string engine_name = "dense";  // as given to -e
+static const char *report_file = 0;  // --report, .json or .csv
+static const char *trace_file = 0;   // --trace
+
+// snapshots (--save, --load, --checkpoint)
+static const char *save_file = 0;
+static const char *load_file = 0;
+static size_t checkpoint_interval = 0;  // 0: save at the end only
+static size_t step_start = 0;  // step of the initial field
+static void la_save_snapshot(const char* filename);
+
+// ----------------------------------------------------------------------
+// simulation engine
+// ----------------------------------------------------------------------
+enum la_engine_t {
+  LA_ENGINE_DENSE,   // la_rotate_and_flip/la_forward over the whole field
+  LA_ENGINE_FUSED,   // la_step_fused over the whole field, ping-pong
+  LA_ENGINE_SPARSE,  // la_ants_rotate/la_ants_forward over the ant list
+  LA_ENGINE_PACKED,  // as sparse, with one bit per square
+  LA_ENGINE_CPU,     // la_cpu_engine, without OpenCL
+  LA_ENGINE_STRIPS,  // la_strip_step on several devices, headless only
+};
+static la_engine_t engine = LA_ENGINE_DENSE;
+
+static std::vector<la_ant> ants;
+static cl_int packed_stride = 0;  // 32-bit words per row (LA_ENGINE_PACKED)
+// byte fields on the device (dense, fused, sparse): squares per row and
+// rows, field_width and field_height unless --layout tiles pads them to
+// whole tiles
+static cl_int field_stride = 0;
+static cl_int field_rows = 0;
+
+// native engine (LA_ENGINE_CPU)
+static la_cpu_engine::mode_t cpu_mode = la_cpu_engine::MODE_AUTO;
+static std::unique_ptr<la_cpu_engine> cpu_engine;
+static bool fast_forward = false;  // skip highways (--fast-forward)
+
+// --rule, compiled into the kernels by la_build_options
+static la_rule rule = la_rule_rl();
+static const char* rule_string = "RL";
+
+// --layout tiles: the byte fields of dense, fused and sparse on the
+// device are stored as tiles of 2^FIELD_TILE_SHIFT squares square
+// (field_index in langtons_ant_kernel.cl), compiled in by
+// la_build_options; the host always sees rows
+static bool field_tiles = false;
+static const int FIELD_TILE_SHIFT = 3;
+
+// initial field kept for --verify
+static bool verify = false;
+static std::vector<cl_char> field_start;
 
 // ----------------------------------------------------------------------
 // cl kernel
 // ----------------------------------------------------------------------
-static const char *kernel_source = "langtons_ant_kernel.cl";
+// langtons_ant_kernel.cl, made into a string literal by the Makefile
+static const char kernel_source[] =
+#include "langtons_ant_kernel.inc"
+  ;
+// compiled programs, by device, driver and source
+static const char PROGRAM_CACHE_DIR[] = "langtons_ant";
 
 // ----------------------------------------------------------------------
 // cl variables
@@ -40,18 +119,195 @@ static cl::CommandQueue command_queue;
 static cl::Program program;
 static cl::Kernel la_kernel_rotate_and_flip;
 static cl::Kernel la_kernel_forward;
+static cl::Kernel la_kernel_step_fused;
 static cl::Kernel la_kernel_clear_image;
 static cl::Kernel la_kernel_draw_image;
+static cl::Kernel la_kernel_ants_rotate;
+static cl::Kernel la_kernel_ants_forward;
+static cl::Kernel la_kernel_ants_draw_image;
+static cl::Kernel la_kernel_packed_ants_rotate;
+static cl::Kernel la_kernel_packed_ants_forward;
+static cl::Kernel la_kernel_packed_ants_draw_image;
+static cl::Kernel la_kernel_view;       // la_view_field or la_view_packed
+static cl::Kernel la_kernel_view_ants;  // sparse and packed engines
 static cl::Buffer dev_field_in;
 static cl::Buffer dev_field_out;
-static cl::Memory dev_image;
+static cl::Buffer dev_ants;
+static cl::Buffer dev_field_packed;
+static cl::ImageGL dev_image;
+
+// ----------------------------------------------------------------------
+// compute thread
+// ----------------------------------------------------------------------
+/*
+  With the window, the OpenCL engines step on their own thread, which
+  draws every batch into dev_frame on command_queue and publishes a copy
+  in dev_frame_front every refresh_mills. The GL thread copies the
+  latest published frame into dev_image on render_queue at its own pace.
+  The two copies are ordered by events only, so neither thread blocks on
+  the other.
+*/
+static cl::CommandQueue render_queue;  // GL thread
+static cl::Image2D dev_frame;          // drawn by the compute thread
+static cl::Image2D dev_frame_front;    // last published frame
+static std::thread compute_thread;
+static std::atomic<bool> compute_quit(false);
+static std::exception_ptr compute_error;
+static std::mutex frame_mutex;  // guards the frame_* state and view_params
+static cl::Event frame_event;   // copy of dev_frame into dev_frame_front
+static cl::Event shown_event;   // copy of dev_frame_front into dev_image
+static bool frame_ready = false;  // frame_event not yet shown
+static bool batch_pending = false;
+static cl::Event batch_event;       // end of the last batch enqueued
+
+// ----------------------------------------------------------------------
+// statistics (--stats)
+// ----------------------------------------------------------------------
+// black, ants, collisions, bounding box x0, y0, x1, y1 (STATS_* in the
+// kernel source)
+static const int STATS_SIZE = 7;
+static const cl_uint stats_init[STATS_SIZE] = {
+  0, 0, 0, 0xffffffff, 0xffffffff, 0, 0};
+static size_t stats_interval = 0;        // --stats N, 0 for none
+static const char *stats_log_file = 0;   // --stats-log
+static std::ofstream stats_log;
+static cl::Kernel la_kernel_stats;
+static cl::Buffer dev_stats;
+static std::vector<cl_uint> stats_values(STATS_SIZE);
+static cl::Event stats_event;
+static bool stats_pending = false;  // read of stats_values in flight
+static size_t stats_step = 0;       // step of the pending read
+static std::string stats_summary;   // latest, for the progress line
+
+// ----------------------------------------------------------------------
+// recording (--record)
+// ----------------------------------------------------------------------
+enum la_record_format {
+  RECORD_RAW,    // frames of the dense layout, one after the other
+  RECORD_DELTA,  // runs of squares changed since the previous frame
+  RECORD_PGM,    // one PGM image per frame
+  RECORD_ANTS,   // CSV of the ant positions
+};
+static const char *record_file = 0;
+static size_t record_interval = 1;  // --record-interval
+static la_record_format record_format = RECORD_RAW;
+
+/*
+  A frame on its way to disk. The compute thread fills it with
+  non-blocking reads into pinned memory, mapped once, and the writer
+  thread waits for their event, encodes the frame and writes it. With
+  RECORD_SLOTS slots the device copies one frame while the previous one
+  is written.
+*/
+struct la_record_slot {
+  cl::Buffer pinned_field;  // CL_MEM_ALLOC_HOST_PTR
+  cl::Buffer pinned_ants;
+  void* field;              // mapped pinned_field
+  la_ant* ants;             // mapped pinned_ants
+  std::vector<cl_char> host_field;  // cpu engines
+  size_t step;
+  cl::Event event;          // last read of the frame
+  bool busy;                // until the writer is done with it
+};
+static const int RECORD_SLOTS = 2;
+static la_record_slot record_slots[RECORD_SLOTS];
+static int record_next = 0;            // slot of the next frame
+static std::deque<int> record_queue;   // slots waiting for the writer
+static std::mutex record_mutex;        // guards the queue and busy flags
+static std::condition_variable record_cv;
+static std::thread record_thread;
+static bool record_done = false;
+static std::ofstream record_out;
+static std::vector<cl_char> record_previous;  // RECORD_DELTA reference
+static size_t record_frames = 0;
+static double record_wait = 0.0;  // seconds spent waiting for a slot
+static void la_record_frame();
+
+// ----------------------------------------------------------------------
+// strip engine (LA_ENGINE_STRIPS): one horizontal strip per device
+// ----------------------------------------------------------------------
+struct la_strip {
+  cl::Device device;
+  cl::Context context;
+  cl::CommandQueue queue;
+  cl::Kernel step;
+  cl::Buffer field[2];  // rows + 2 rows each, one halo row on each side
+  cl_int y0;            // first row owned in the whole field
+  cl_int rows;          // rows owned
+  // first and last rows owned, read back for the neighbours;
+  // two sets so that a step can read while the previous one writes
+  std::vector<cl_char> first_row[2];
+  std::vector<cl_char> last_row[2];
+  cl_ulong kernel_ns;   // time spent in la_strip_step
+};
+static std::vector<la_strip> strips;
+static int strip_cur = 0;     // field[strip_cur] is the current field
+static int strip_parity = 0;  // staging set used by the next exchange
+static std::vector<size_t> strip_devices;  // -D, default -d
+static size_t sub_devices = 0;             // -S, CPU sub-devices per device
+
+// ----------------------------------------------------------------------
+// ensemble (-B)
+// ----------------------------------------------------------------------
+static size_t ensemble_runs = 0;         // independent fields
+static std::vector<int> ensemble_ants;  // -n N,N...: ants of the runs
+static cl::Kernel la_kernel_ensemble_step;
+static cl::Kernel la_kernel_ensemble_stats;
+static cl::Buffer dev_ensemble_stats;
+
+// ----------------------------------------------------------------------
+// kernel timing (--report, --profile, --trace)
+// ----------------------------------------------------------------------
+// log2 buckets of microseconds: below 1, below 2, below 4, ...
+static const int PROFILE_BUCKETS = 32;
+struct la_histogram {
+  size_t buckets[PROFILE_BUCKETS];
+};
+struct la_kernel_time {
+  size_t count;
+  cl_ulong ns;
+  la_histogram queued;  // queued -> submit
+  la_histogram submit;  // submit -> start
+  la_histogram run;     // start -> end
+};
+static bool kernel_timing = false;  // profile command_queue
+static bool profile = false;        // --profile, print the histograms
+static const double PROFILE_INTERVAL = 10.0;  // seconds between prints
+static std::chrono::steady_clock::time_point profile_clock;
+static std::ofstream trace;         // --trace, Chrome trace events
+static size_t trace_events = 0;
+static cl_ulong trace_base = 0;     // device time of the first event
+static std::map<std::string, la_kernel_time> kernel_times;
+static std::vector<std::pair<std::string, cl::Event>> kernel_events;
+static std::mutex kernel_events_mutex;  // the GL thread records too
 
 // ----------------------------------------------------------------------
 // work size info
 // ----------------------------------------------------------------------
-static std::vector<cl_int> elements_size;
-static std::vector<cl_int> global_work_size;
-static std::vector<cl_int> local_work_size;
+static std::vector<cl_int> local_work_size;  // of the step kernel, 0 if any
+// work-group size until the tuning without -l, which picks one per kernel
+static const cl_int FIELD_ALIGN = 16;
+static bool autotune = true;
+static cl::NDRange local_rotate_and_flip;
+static cl::NDRange local_forward;
+static cl::NDRange local_step_fused;
+static cl::NDRange local_draw;  // la_draw_image and la_clear_image
+
+/*
+  Global range of a field kernel over width x height squares with the
+  work-group size local: rounded up to whole work-groups, the work-items
+  beyond the field doing nothing.
+*/
+static cl::NDRange la_field_range(const cl::NDRange& local,
+                                  cl_int width = field_width,
+                                  cl_int height = field_height) {
+  if (local.dimensions() == 0) {
+    return cl::NDRange(width, height);
+  }
+  const size_t w = local.get()[0];
+  const size_t h = local.get()[1];
+  return cl::NDRange((width + w - 1) / w * w, (height + h - 1) / h * h);
+}
 
 // ----------------------------------------------------------------------
 // gl variables
@@ -67,13 +323,66 @@ static int window_pos_y   = 50;      // Windowed mode's top-left corner y
 static GLfloat translate_x = 0.0f;
 static GLfloat translate_y = 0.0f;
 static GLfloat zoom = 1.0f;
+// level-of-detail view (--lod): the window is drawn at its own resolution
+// by la_view_* instead of showing a texture of the whole field
+static const int VIEW_MAX_WINDOW = 1024;  // auto above this field size
+static int lod_mode = -1;     // --lod: 1 on, 0 off, -1 auto
+static bool lod = false;
+static int view_width = 0;       // current window size
+static int view_height = 0;
+static GLsizei view_texture_width = 0;  // rendered_texture, screen size
+static GLsizei view_texture_height = 0;
+struct la_view_params {
+  GLfloat zoom;
+  GLfloat translate_x;
+  GLfloat translate_y;
+  int width;
+  int height;
+};
+static la_view_params view_params = {};  // handed over by the GL thread
+static la_view_params view_drawn = {};   // last view drawn
 static const GLfloat ORTHO_LEFT = -1.0f;
 static const GLfloat ORTHO_RIGHT = 1.0f;
 static const GLfloat ORTHO_TOP = 1.0f;
 static const GLfloat ORTHO_BOTTOM = -1.0f;
-static clock_t wall_clock = 0;
+static std::chrono::steady_clock::time_point wall_clock;
+
+static GLuint rendered_texture;  // GL_R8, one palette index per square
+static GLuint palette_program;   // fragment shader mapping it to colours
 
-static GLuint rendered_texture;
+// colours of the PALETTE_* indices in the kernel source
+enum {
+  PALETTE_UNSEEN = 0,
+  PALETTE_BW_CLEAR = 1,
+  PALETTE_BW_SET = 2,
+  PALETTE_BLACK = 3,
+  PALETTE_ANT = 4,
+  PALETTE_OUTSIDE = 5,
+  PALETTE_COLOURS = 6,  // colours 2 and up of a --rule
+  PALETTE_SIZE = PALETTE_COLOURS + LA_RULE_MAX_COLOURS - 2,
+};
+static const GLfloat palette[PALETTE_SIZE][3] = {
+  {1.0f, 1.0f, 1.0f},  // white, never drawn
+  {0.0f, 0.0f, 0.0f},  // black
+  {1.0f, 0.8f, 0.8f},  // light red
+  {0.0f, 0.0f, 0.0f},  // black squares in the view
+  {1.0f, 0.2f, 0.2f},  // ants in the view
+  {0.3f, 0.3f, 0.3f},  // off the field in the view
+  {0.2f, 0.4f, 1.0f},  // colour 2, blue
+  {0.2f, 0.8f, 0.3f},  // colour 3, green
+  {1.0f, 0.8f, 0.1f},  // colour 4, yellow
+  {0.7f, 0.3f, 0.9f},  // colour 5, purple
+  {0.1f, 0.8f, 0.8f},  // colour 6, cyan
+  {1.0f, 0.5f, 0.0f},  // colour 7, orange
+};
+// preceded by the #version line and the PALETTE_SIZE of the host
+static const char palette_shader_source[] =
+  "uniform sampler2D field;\n"
+  "uniform vec3 palette[PALETTE_SIZE];\n"
+  "void main() {\n"
+  "  int i = int(texture2D(field, gl_TexCoord[0].st).r * 255.0 + 0.5);\n"
+  "  gl_FragColor = vec4(palette[i], 1.0);\n"
+  "}\n";
 
 static void report_cl_error(const cl::Error& err) {
   const char* s = "-";
@@ -160,6 +469,16 @@ static void report_cl_error(const cl::Error& err) {
     ": " << s << "(" << err.err() << ")" << std::endl;
 }
 
+// Print a progress line, overwriting the previous one.
+static void show_report(std::string s) {
+  static std::string report;
+  if (s.size() < report.size()) {
+    s += std::string(report.size() - s.size(), ' ');
+  }
+  report = s;
+  std::cout << report << "\r" << std::flush;
+}
+
 // ----------------------------------------------------------------------
 // gl functions
 // ----------------------------------------------------------------------
@@ -177,26 +496,41 @@ static void display_cb() {
   glOrtho(ORTHO_LEFT, ORTHO_RIGHT,
           ORTHO_BOTTOM, ORTHO_TOP,
           -10, 10);
-  glScalef(zoom, zoom, 1.0f);
-  glTranslatef(translate_x, translate_y, 0.0f);
+  // the view is already zoomed and translated, in the lower left corner
+  // of the texture
+  GLfloat s1 = 1.0f;
+  GLfloat t1 = 1.0f;
+  if (lod) {
+    s1 = static_cast<GLfloat>(std::min(view_width, view_texture_width))
+      / view_texture_width;
+    t1 = static_cast<GLfloat>(std::min(view_height, view_texture_height))
+      / view_texture_height;
+  } else {
+    glScalef(zoom, zoom, 1.0f);
+    glTranslatef(translate_x, translate_y, 0.0f);
+  }
 
   glEnable(GL_TEXTURE_2D);
   glBindTexture(GL_TEXTURE_2D, rendered_texture);
   glCheck_("glBindTexture");
+  glUseProgram(palette_program);
   glBegin(GL_TRIANGLES);
   glTexCoord2f(0.0f, 0.0f); glVertex3f(-1.0f, -1.0f, 0.0f);
-  glTexCoord2f(1.0f, 0.0f); glVertex3f(1.0f,  -1.0f, 0.0f);
-  glTexCoord2f(1.0f, 1.0f); glVertex3f(1.0f,   1.0f, 0.0f);
-  glTexCoord2f(1.0f, 1.0f); glVertex3f(1.0f,   1.0f, 0.0f);
-  glTexCoord2f(0.0f, 1.0f); glVertex3f(-1.0f,  1.0f, 0.0f);
+  glTexCoord2f(s1, 0.0f); glVertex3f(1.0f,  -1.0f, 0.0f);
+  glTexCoord2f(s1, t1); glVertex3f(1.0f,   1.0f, 0.0f);
+  glTexCoord2f(s1, t1); glVertex3f(1.0f,   1.0f, 0.0f);
+  glTexCoord2f(0.0f, t1); glVertex3f(-1.0f,  1.0f, 0.0f);
   glTexCoord2f(0.0f, 0.0f); glVertex3f(-1.0f, -1.0f, 0.0f);
   glEnd();
+  glUseProgram(0);
   glutSwapBuffers();
 }
 
 static void reshape_cb(GLsizei width, GLsizei height) {
   // Set the viewport to cover the new window
   glViewport(0, 0, width, height);
+  view_width = width;
+  view_height = height;
 
   // Set the aspect ratio of the clipping area to match the viewport
   glMatrixMode(GL_PROJECTION);  // To operate on the Projection matrix
@@ -237,10 +571,12 @@ static void specialKeys_cb(int key, int x, int y) {
 static void nonspecialKeys_cb(unsigned char key, int x, int y) {
   switch (key) {
   case 'p':
-    if (paused == 0) {
-      paused = 2;
-    } else {
-      paused = 0;
+    {
+      // pause after the current batch, or resume
+      int running = 0;
+      if (!paused.compare_exchange_strong(running, 2)) {
+        paused = 0;
+      }
     }
     break;
   case 'q':
@@ -281,8 +617,49 @@ wheel_cb(int wheel, int direction, int x, int y) {
   glutPostRedisplay();
 }
 
+/*
+  Compile the fragment shader that maps the palette indices of
+  rendered_texture to colours.
+*/
+static void initPaletteShader() {
+  const GLuint shader = glCreateShader(GL_FRAGMENT_SHADER);
+  std::stringstream ss;
+  ss << "#version 120\n#define PALETTE_SIZE " << PALETTE_SIZE << "\n";
+  const std::string header = ss.str();
+  const char* sources[] = {header.c_str(), palette_shader_source};
+  glShaderSource(shader, 2, sources, 0);
+  glCompileShader(shader);
+  GLint ok = GL_FALSE;
+  glGetShaderiv(shader, GL_COMPILE_STATUS, &ok);
+  if (!ok) {
+    char log[1024];
+    glGetShaderInfoLog(shader, sizeof(log), 0, log);
+    std::cerr << "palette shader: " << log << std::endl;
+    exit(1);
+  }
+  palette_program = glCreateProgram();
+  glAttachShader(palette_program, shader);
+  glLinkProgram(palette_program);
+  glGetProgramiv(palette_program, GL_LINK_STATUS, &ok);
+  if (!ok) {
+    char log[1024];
+    glGetProgramInfoLog(palette_program, sizeof(log), 0, log);
+    std::cerr << "palette shader: " << log << std::endl;
+    exit(1);
+  }
+  glUseProgram(palette_program);
+  glUniform1i(glGetUniformLocation(palette_program, "field"), 0);
+  glUniform3fv(glGetUniformLocation(palette_program, "palette"),
+               PALETTE_SIZE, &palette[0][0]);
+  glUseProgram(0);
+  glCheck_("initPaletteShader");
+}
+
 static void initGL(int argc, char *argv[]) {
   glutInit(&argc, argv);
+  // return from glutMainLoop to stop the compute thread and save
+  glutSetOption(GLUT_ACTION_ON_WINDOW_CLOSE,
+                GLUT_ACTION_GLUTMAINLOOP_RETURNS);
   glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGBA);
   glutInitWindowSize(window_width, window_height);
   glutInitWindowPosition(window_pos_x, window_pos_y);
@@ -307,341 +684,3149 @@ static void initGL(int argc, char *argv[]) {
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F,
-               field_width, field_height,
-               0, GL_RGBA, GL_FLOAT, 0);
+  if (lod) {
+    // large enough for any window size
+    view_texture_width = glutGet(GLUT_SCREEN_WIDTH);
+    view_texture_height = glutGet(GLUT_SCREEN_HEIGHT);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R8,
+                 view_texture_width, view_texture_height,
+                 0, GL_RED, GL_UNSIGNED_BYTE, 0);
+  } else {
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R8,
+                 field_width, field_height,
+                 0, GL_RED, GL_UNSIGNED_BYTE, 0);
+  }
   glCheck_("glTexImage2D");
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+  initPaletteShader();
   glFinish();
 }
 
-static void displayTimer_cb(int dummy) {
-  glutPostRedisplay();
-  glutTimerFunc(refresh_mills, displayTimer_cb, 0);
+// size of rendered_texture and the frames drawn for it
+static std::array<size_t, 3> la_frame_region() {
+  if (lod) {
+    return {static_cast<size_t>(view_texture_width),
+            static_cast<size_t>(view_texture_height), 1};
+  }
+  return {static_cast<size_t>(field_width),
+          static_cast<size_t>(field_height), 1};
 }
 
 static bool first = true;
 
 static int step_count = 0;
+static std::atomic<int> frame_count(0);  // frames shown
+static int adaptive_steps = 1;
 
-static void generationTimer_cb(int dummy) {
-  if (paused == 1) {
-    glutTimerFunc(gen_mills, generationTimer_cb, 0);
+// keep event until la_collect_kernel_times, from either thread
+static void la_record_event(const std::string& name, const cl::Event& event) {
+  std::lock_guard<std::mutex> lock(kernel_events_mutex);
+  kernel_events.push_back(std::make_pair(name, event));
+}
+
+/*
+  Enqueue kernel on command_queue. With kernel_timing, its event is kept
+  until la_collect_kernel_times.
+*/
+static void la_enqueue_kernel(cl::Kernel& kernel,
+                              const cl::NDRange& global,
+                              const cl::NDRange& local) {
+  if (!kernel_timing) {
+    command_queue.enqueueNDRangeKernel(kernel, cl::NullRange, global, local);
     return;
   }
-  try {
-    std::vector<cl::Memory> dev_image_vec({dev_image});
-    command_queue.enqueueAcquireGLObjects(&dev_image_vec);
-    command_queue.enqueueNDRangeKernel(la_kernel_rotate_and_flip,
-                                       cl::NullRange,
-                                       cl::NDRange(global_work_size[0],
-                                                   global_work_size[1]),
-                                       cl::NDRange(local_work_size[0],
-                                                   local_work_size[1]));
-    command_queue.enqueueNDRangeKernel(la_kernel_forward,
-                                       cl::NullRange,
-                                       cl::NDRange(global_work_size[0],
-                                                   global_work_size[1]),
-                                       cl::NDRange(local_work_size[0],
-                                                   local_work_size[1]));
-    if (first) {
-      command_queue.enqueueNDRangeKernel(la_kernel_clear_image,
-                                         cl::NullRange,
-                                         cl::NDRange(global_work_size[0],
-                                                     global_work_size[1]),
-                                         cl::NDRange(local_work_size[0],
-                                                     local_work_size[1]));
-      first = false;
-    }
-    command_queue.enqueueNDRangeKernel(la_kernel_draw_image,
-                                       cl::NullRange,
-                                       cl::NDRange(global_work_size[0],
-                                                   global_work_size[1]),
-                                       cl::NDRange(local_work_size[0],
-                                                   local_work_size[1]));
-
-    // command_queue.finish();
-    command_queue.flush();
-
-    command_queue.enqueueReleaseGLObjects(&dev_image_vec);
-    ++step;
-    ++step_count;
+  cl::Event event;
+  command_queue.enqueueNDRangeKernel(kernel, cl::NullRange, global, local,
+                                     0, &event);
+  la_record_event(kernel.getInfo<CL_KERNEL_FUNCTION_NAME>(), event);
+}
 
-    const clock_t now = clock();
-    if (now > wall_clock + CLOCKS_PER_SEC) {
-      const double fps = static_cast<double>(step_count)
-        / ((now - wall_clock) / CLOCKS_PER_SEC);
-      step_count = 0;
-      static std::string report;
-      std::stringstream ss;
-      ss << "step[" << step << "],fps[" << fps << "]";
-      std::string s = ss.str();
-      if (s.size() < report.size()) {
-        s += std::string(report.size() - s.size(), ' ');
-      }
-      report = s;
-      std::cout << report << "\r" << std::flush;
-      wall_clock = now;
-    }
-    if (paused == 2) {
-      paused = 1;
-    }
-    glutTimerFunc(gen_mills, generationTimer_cb, 0);
-  } catch (const cl::Error& err) {
-    std::cerr << err.what() << std::endl;
-    throw;
+/*
+  Acquire or release the GL objects on queue. With kernel_timing, the
+  commands are timed like the kernels, as acquire_gl and release_gl.
+*/
+static void la_enqueue_acquire_gl(const cl::CommandQueue& queue,
+                                  const std::vector<cl::Memory>& objects) {
+  if (!kernel_timing) {
+    queue.enqueueAcquireGLObjects(&objects);
+    return;
   }
+  cl::Event event;
+  queue.enqueueAcquireGLObjects(&objects, 0, &event);
+  la_record_event("acquire_gl", event);
 }
 
-static void startGL() {
-  glutTimerFunc(0, displayTimer_cb, 0);
-  glutTimerFunc(0, generationTimer_cb, 0);
-  glutMainLoop();
+static void la_enqueue_release_gl(const cl::CommandQueue& queue,
+                                  const std::vector<cl::Memory>& objects) {
+  if (!kernel_timing) {
+    queue.enqueueReleaseGLObjects(&objects);
+    return;
+  }
+  cl::Event event;
+  queue.enqueueReleaseGLObjects(&objects, 0, &event);
+  la_record_event("release_gl", event);
 }
 
-// ----------------------------------------------------------------------
-// utility function
-// ----------------------------------------------------------------------
-static std::string loadProgramSource(const char *filename) {
-  std::ifstream ifs(filename);
-  const std::string content((std::istreambuf_iterator<char>(ifs)),
-                            (std::istreambuf_iterator<char>()));
-  return content;
+static void la_histogram_add(la_histogram& h, cl_ulong ns) {
+  const cl_ulong us = ns / 1000;
+  const int b = (us == 0) ? 0 : 64 - __builtin_clzll(us);
+  ++h.buckets[std::min(b, PROFILE_BUCKETS - 1)];
 }
 
-// ----------------------------------------------------------------------
-// game functions
-// ----------------------------------------------------------------------
+/*
+  One complete event per command in the Chrome trace format, on thread
+  tid (the strip, 0 for command_queue), in microseconds from the first
+  command. The latencies before the start go into args.
+*/
+static void la_trace_event(const std::string& name, int tid,
+                           cl_ulong queued, cl_ulong submit,
+                           cl_ulong start, cl_ulong end) {
+  if (trace_events == 0) {
+    trace_base = queued;
+    trace << "[" << std::endl;
+  } else {
+    trace << "," << std::endl;
+  }
+  ++trace_events;
+  trace << "{\"name\":\"" << name << "\",\"ph\":\"X\",\"pid\":0"
+        << ",\"tid\":" << tid
+        << ",\"ts\":" << (static_cast<double>(start - trace_base) * 1e-3)
+        << ",\"dur\":" << ((end - start) * 1e-3)
+        << ",\"args\":{\"queued_us\":" << ((submit - queued) * 1e-3)
+        << ",\"submit_us\":" << ((start - submit) * 1e-3) << "}}";
+}
 
-void la_init_random_field(std::vector<cl_char>& field_init) {
-  unsigned seed = time(0);
-  srand(seed);
-  for (int i = 0; i < n_ants; ++i) {
-    int y = rand_r(&seed) % field_height;
-    int x = rand_r(&seed) % field_width;
-    int d = (1 << (rand_r(&seed) % 4));
-    field_init[y * field_width + x] = d;
+static void la_add_kernel_time(const std::string& name,
+                               const cl::Event& event, int tid = 0) {
+  const cl_ulong queued =
+    event.getProfilingInfo<CL_PROFILING_COMMAND_QUEUED>();
+  const cl_ulong submit =
+    event.getProfilingInfo<CL_PROFILING_COMMAND_SUBMIT>();
+  const cl_ulong start = event.getProfilingInfo<CL_PROFILING_COMMAND_START>();
+  const cl_ulong end = event.getProfilingInfo<CL_PROFILING_COMMAND_END>();
+  la_kernel_time& t = kernel_times[name];
+  ++t.count;
+  t.ns += end - start;
+  la_histogram_add(t.queued, submit - queued);
+  la_histogram_add(t.submit, start - submit);
+  la_histogram_add(t.run, end - start);
+  if (trace.is_open()) {
+    la_trace_event(name, tid, queued, submit, start, end);
   }
 }
 
-inline void rtrim(std::string &s) {
-    s.erase(std::find_if(s.rbegin(), s.rend(), [](unsigned char ch) {
-        return !std::isspace(ch);
-    }).base(), s.end());
+/*
+  Wait for the kernels enqueued since the last call and add up their
+  device time per kernel.
+*/
+static void la_collect_kernel_times() {
+  std::vector<std::pair<std::string, cl::Event>> events;
+  {
+    std::lock_guard<std::mutex> lock(kernel_events_mutex);
+    events.swap(kernel_events);
+  }
+  for (const auto& e : events) {
+    e.second.wait();
+    la_add_kernel_time(e.first, e.second);
+  }
 }
 
-bool with_cl_gl_sharing(const std::string& extensions) {
-  std::stringstream ex_ss(extensions);
-  std::string ex_item;
-  while (std::getline(ex_ss, ex_item, ' ')) {
-    if (ex_item == "cl_khr_gl_sharing") {
-      return true;
+// upper bound in microseconds of the bucket holding the quantile q
+static cl_ulong la_histogram_quantile(const la_histogram& h, size_t count,
+                                      double q) {
+  size_t seen = 0;
+  for (int b = 0; b < PROFILE_BUCKETS; ++b) {
+    seen += h.buckets[b];
+    if (seen > 0 && seen >= q * count) {
+      return 1ULL << b;
     }
   }
-  return false;
+  return 1ULL << (PROFILE_BUCKETS - 1);
 }
 
-int main(int argc, char *argv[]) {
-  try {
-    size_t device_index = 0;
-    for (;;) {
-      int option_index = 0;
-      static struct option long_options[] = {
-        {"device", required_argument, 0, 'd'},
-        {"width", required_argument, 0, 'w'},
-        {"height", required_argument, 0, 'h'},
-        {"nants", required_argument, 0, 'n'},
-        {"interval", required_argument, 0, 'i'},
-        {"pause", no_argument, 0, 'P'},
-        {0, 0, 0}};
-      int opt = getopt_long(argc, argv, "d:w:h:n:i:P",
-                            long_options, &option_index);
-      if (opt == -1) {
-        break;
-      }
-      switch (opt) {
-      case 'd':
-        device_index = atoi(optarg);
-        break;
-      case 'w':
-        {
-          const int w = atoi(optarg);
-          field_width = w;
-          window_width = w;
-        }
-        break;
-      case 'h':
-        {
-          const int h = atoi(optarg);
-          field_height = h;
-          window_height = h;
-        }
-        break;
-      case 'n':
-        n_ants = atoi(optarg);
-        break;
-      case 'i':
-        gen_mills = atoi(optarg);
-        break;
-      case 'P':
-        paused = 2;
-        break;
-      default:
-        std::cerr << "Usage: " << argv[0] <<
-          " [-d N]"
-          " [-w width]"
-          " [-h height]"
-          " [-i interval_millis]"
-          " [-P]" << std::endl;
-        std::cerr << " -d, --device    : Select compute device." << std::endl;
-        std::cerr << " -w, --width     : Field width." << std::endl;
-        std::cerr << " -h, --height    : Field height." << std::endl;
-        std::cerr << " -n, --nants     : Number of ants." << std::endl;
-        std::cerr << " -i, --interval  : Step interval in milli seconds." << std::endl;
-        std::cerr << " -P, --pause     : Pause at start. Will be released by 'p' key." << std::endl;
-        exit(1);
-      }
+static void la_print_histogram(const char* label, const la_histogram& h,
+                               size_t count) {
+  std::cout << "  " << label
+            << " p50[<" << la_histogram_quantile(h, count, 0.5) << "us]"
+            << ",p99[<" << la_histogram_quantile(h, count, 0.99) << "us]";
+  for (int b = 0; b < PROFILE_BUCKETS; ++b) {
+    if (h.buckets[b] != 0) {
+      std::cout << " <" << (1ULL << b) << "us:" << h.buckets[b];
     }
-    initGL(argc, argv);
-    elements_size = std::vector<cl_int>({
-        field_width, field_height});  // cell slots
-    local_work_size = std::vector<cl_int>({
-        32, 32});
-    global_work_size = std::vector<cl_int>({
-        static_cast<cl_int>(ceil(
-            static_cast<double>(elements_size[0])
-            / local_work_size[0]) * local_work_size[0]),
-        static_cast<cl_int>(ceil(
-            static_cast<double>(elements_size[1])
-            / local_work_size[1]) * local_work_size[1])});
-    std::cout << "global_work_size[0]=" << global_work_size[0]
-              << ", local_work_size[0]=" << local_work_size[0]
-              << ", elements_size[0]=" << elements_size[0]
-              << ", work_groups_x="
-              << (global_work_size[0] / local_work_size[0])
-              << std::endl;
-    std::cout << "global_work_size[1]=" << global_work_size[1]
-              << ", local_work_size[1]=" << local_work_size[1]
-              << ", elements_size[1]=" << elements_size[1]
-              << ", work_groups_y="
-              << (global_work_size[1] / local_work_size[1])
-              << std::endl;
-    /* allocate host memory */
-    field_image.resize(global_work_size[0] * global_work_size[1] * 4);
-    /* end allocate host memory */
+  }
+  std::cout << std::endl;
+}
 
-    /* init field_init */
-    std::vector<cl_char> field_init;
-    field_init.resize(global_work_size[0] * global_work_size[1]);
-    la_init_random_field(field_init);
-    /* end init field_init */
+/*
+  Per command since the start: count and device time, then the histograms
+  of the time spent queued on the host (queued -> submit), waiting on the
+  device (submit -> start) and running (start -> end).
+*/
+static void la_print_profile() {
+  for (const auto& kv : kernel_times) {
+    const la_kernel_time& t = kv.second;
+    std::cout << kv.first << " count[" << t.count << "]"
+              << ",seconds[" << (t.ns * 1e-9) << "]" << std::endl;
+    la_print_histogram("queued", t.queued, t.count);
+    la_print_histogram("submit", t.submit, t.count);
+    la_print_histogram("run   ", t.run, t.count);
+  }
+}
 
-    std::vector<cl::Platform> platforms;
-    bool device_found = false;
-    size_t dev_index = 0;
-    cl::Platform::get(&platforms);
-    for (cl::Platform& plat : platforms) {
-      for (cl_device_type device_type
-             : {CL_DEVICE_TYPE_CPU, CL_DEVICE_TYPE_GPU}) {
-        std::vector<cl::Device> devices;
-        plat.getDevices(device_type, &devices);
-        for (cl::Device& dev : devices) {
-          const std::string extensions = dev.getInfo<CL_DEVICE_EXTENSIONS>();
-          if (!with_cl_gl_sharing(extensions)) {
-            continue;
-          }
-          const std::string devvendor = dev.getInfo<CL_DEVICE_VENDOR>();
-          const std::string devname = dev.getInfo<CL_DEVICE_NAME>();
-          const std::string devver = dev.getInfo<CL_DEVICE_VERSION>();
-          std::cout << ((dev_index == device_index) ? '*' : ' ') <<
-            "device[" << dev_index << "]: vendor[" << devvendor << "]"
-            ",name[" << devname << "]"
-            ",version[" << devver << "]" << std::endl;
-          if (dev_index == device_index) {
-            platform = plat;
-            device = dev;
-            device_found = true;
-          }
-          ++dev_index;
-        }
-      }
+// print the histograms every PROFILE_INTERVAL seconds with --profile
+static void la_profile_tick() {
+  const auto now = std::chrono::steady_clock::now();
+  if (!profile || std::chrono::duration<double>(
+          now - profile_clock).count() < PROFILE_INTERVAL) {
+    return;
+  }
+  profile_clock = now;
+  std::cout << std::endl;
+  la_print_profile();
+}
+
+static void la_end_profile() {
+  if (profile) {
+    la_print_profile();
+  }
+  if (trace.is_open()) {
+    trace << std::endl << "]" << std::endl;
+    trace.close();
+  }
+}
+
+/*
+  Write the statistics read back for stats_step to stats_summary and the
+  --stats-log file. The ants of the sparse and packed engines are not in
+  the field: their count comes from the host and collisions are left out.
+*/
+static void la_emit_stats() {
+  const bool ants_in_field =
+    (engine == LA_ENGINE_DENSE || engine == LA_ENGINE_FUSED);
+  const cl_uint n = ants_in_field ? stats_values[1] : ants.size();
+  const cl_uint black = stats_values[0];
+  std::stringstream ss;
+  ss << "black[" << black << "],ants[" << n << "]";
+  if (ants_in_field) {
+    ss << ",collisions[" << stats_values[2] << "]";
+  }
+  if (black != 0) {
+    ss << ",bbox[" << stats_values[3] << "," << stats_values[4] << ","
+       << stats_values[5] << "," << stats_values[6] << "]";
+  }
+  stats_summary = ss.str();
+  if (stats_log.is_open()) {
+    stats_log << stats_step << "," << black << "," << n << ",";
+    if (ants_in_field) {
+      stats_log << stats_values[2];
     }
-    if (!device_found) {
-      std::cerr << "device[" << device_index << "] not found" << std::endl;
-      exit(1);
+    stats_log << ",";
+    if (black != 0) {
+      stats_log << stats_values[3] << "," << stats_values[4] << ","
+                << stats_values[5] << "," << stats_values[6];
+    } else {
+      stats_log << ",,,";
     }
-    const cl_platform_id platform_id = device.getInfo<CL_DEVICE_PLATFORM>()();
-    cl_context_properties properties[7];
-    properties[0] = CL_GL_CONTEXT_KHR;
-    properties[1] =
-      reinterpret_cast<cl_context_properties>(glXGetCurrentContext());
-    properties[2] = CL_GLX_DISPLAY_KHR;
-    properties[3] =
-      reinterpret_cast<cl_context_properties>(glXGetCurrentDisplay());
-    properties[4] = CL_CONTEXT_PLATFORM;
-    properties[5] = reinterpret_cast<cl_context_properties>(platform_id);
-    properties[6] = 0;
-
-    clGetGLContextInfoKHR_fn myGetGLContextInfoKHR =
-      reinterpret_cast<clGetGLContextInfoKHR_fn>(
-          clGetExtensionFunctionAddressForPlatform(
-              platform_id, "clGetGLContextInfoKHR"));
+    stats_log << std::endl;
+  }
+}
 
-    size_t size;
-    myGetGLContextInfoKHR(properties, CL_DEVICES_FOR_GL_CONTEXT_KHR,
-                          sizeof(cl_device_id), &device, &size);
+/*
+  Emit the pending statistics once their read has completed, or wait for
+  it with wait.
+*/
+static void la_poll_stats(bool wait) {
+  if (!stats_pending) {
+    return;
+  }
+  if (!wait
+      && stats_event.getInfo<CL_EVENT_COMMAND_EXECUTION_STATUS>()
+         != CL_COMPLETE) {
+    return;
+  }
+  stats_event.wait();
+  stats_pending = false;
+  la_emit_stats();
+}
 
-    context = cl::Context(device, properties);
-    command_queue = cl::CommandQueue(context, device, 0);
+/*
+  Enqueue the reduction of the current field and a non-blocking read of
+  the result, after the generations already enqueued. Only one read is
+  in flight at a time.
+*/
+static void la_enqueue_stats() {
+  la_poll_stats(true);
+  command_queue.enqueueWriteBuffer(dev_stats, CL_FALSE, 0,
+                                   sizeof(stats_init), stats_init);
+  // whole multiples of FIELD_ALIGN leave the driver room to pick the
+  // work-group size; the kernels skip the work-items beyond the field
+  const cl::NDRange align(FIELD_ALIGN, FIELD_ALIGN);
+  if (engine == LA_ENGINE_PACKED) {
+    la_kernel_stats.setArg(0, dev_field_packed);
+    la_enqueue_kernel(la_kernel_stats,
+                      la_field_range(align, packed_stride, field_height),
+                      cl::NullRange);
+  } else {
+    la_kernel_stats.setArg(0, dev_field_in);
+    la_enqueue_kernel(la_kernel_stats, la_field_range(align),
+                      cl::NullRange);
+  }
+  command_queue.enqueueReadBuffer(dev_stats, CL_FALSE, 0,
+                                  sizeof(cl_uint) * STATS_SIZE,
+                                  &stats_values.front(), 0, &stats_event);
+  command_queue.flush();
+  stats_pending = true;
+  stats_step = step;
+}
 
-    /* create buffers */
-    dev_image = cl::ImageGL(
-        context, CL_MEM_WRITE_ONLY, GL_TEXTURE_2D,
-        0, rendered_texture);
-    dev_field_in = cl::Buffer(
-        context, CL_MEM_READ_WRITE,
-        sizeof(cl_char) * global_work_size[0] * global_work_size[1]);
-    dev_field_out = cl::Buffer(
-        context, CL_MEM_READ_WRITE,
-        sizeof(cl_char) * global_work_size[0] * global_work_size[1]);
-    /* end create buffers */
+/*
+  One generation of the strip engine. Every device steps its strip, then
+  the first and last rows are read back and written into the halo rows
+  of the neighbours. Reads and writes of all devices are enqueued before
+  waiting, so the transfers of different devices overlap; the host only
+  waits for the reads, the writes complete before the next step on each
+  in-order queue.
+*/
+static void la_strips_step() {
+  const size_t n = strips.size();
+  const cl_int width = field_width;
+  const int next = 1 - strip_cur;
+  std::vector<cl::Event> step_events(n);
+  std::vector<cl::Event> read_events(2 * n);
+  for (size_t i = 0; i < n; ++i) {
+    la_strip& s = strips[i];
+    s.step.setArg(0, s.field[strip_cur]);
+    s.step.setArg(1, s.field[next]);
+    s.queue.enqueueNDRangeKernel(s.step,
+                                 cl::NullRange,
+                                 cl::NDRange(width, s.rows),
+                                 cl::NullRange,
+                                 0, &step_events[i]);
+    s.queue.enqueueReadBuffer(s.field[next], CL_FALSE,
+                              sizeof(cl_char) * width, width,
+                              &s.first_row[strip_parity].front(),
+                              0, &read_events[2 * i]);
+    s.queue.enqueueReadBuffer(s.field[next], CL_FALSE,
+                              sizeof(cl_char) * width * s.rows, width,
+                              &s.last_row[strip_parity].front(),
+                              0, &read_events[2 * i + 1]);
+    s.queue.flush();
+  }
+  strip_cur = next;
+  cl::Event::waitForEvents(read_events);
+  for (size_t i = 0; i < n; ++i) {
+    la_strip& s = strips[i];
+    const la_strip& above = strips[(i + n - 1) % n];
+    const la_strip& below = strips[(i + 1) % n];
+    s.queue.enqueueWriteBuffer(s.field[strip_cur], CL_FALSE, 0, width,
+                               &above.last_row[strip_parity].front());
+    s.queue.enqueueWriteBuffer(s.field[strip_cur], CL_FALSE,
+                               sizeof(cl_char) * width * (s.rows + 1), width,
+                               &below.first_row[strip_parity].front());
+    s.queue.flush();
+    s.kernel_ns +=
+      step_events[i].getProfilingInfo<CL_PROFILING_COMMAND_END>()
+      - step_events[i].getProfilingInfo<CL_PROFILING_COMMAND_START>();
+    la_add_kernel_time("la_strip_step", step_events[i], i);
+  }
+  strip_parity = 1 - strip_parity;
+}
 
-    const std::string source_string = loadProgramSource(kernel_source);
+/*
+  Run k generations. OpenCL engines only enqueue them.
+*/
+static void la_enqueue_generations(size_t k) {
+  switch (engine) {
+  case LA_ENGINE_DENSE:
+    for (size_t i = 0; i < k; ++i) {
+      la_enqueue_kernel(la_kernel_rotate_and_flip,
+                        la_field_range(local_rotate_and_flip),
+                        local_rotate_and_flip);
+      la_enqueue_kernel(la_kernel_forward,
+                        la_field_range(local_forward),
+                        local_forward);
+    }
+    break;
+  case LA_ENGINE_FUSED:
+    for (size_t i = 0; i < k; ++i) {
+      la_kernel_step_fused.setArg(0, dev_field_in);
+      la_kernel_step_fused.setArg(1, dev_field_out);
+      la_enqueue_kernel(la_kernel_step_fused,
+                        la_field_range(local_step_fused),
+                        local_step_fused);
+      // the current field is always dev_field_in
+      std::swap(dev_field_in, dev_field_out);
+    }
+    break;
+  case LA_ENGINE_SPARSE:
+    if (ants.empty()) {
+      break;
+    }
+    for (size_t i = 0; i < k; ++i) {
+      la_enqueue_kernel(la_kernel_ants_rotate,
+                        cl::NDRange(ants.size()),
+                        cl::NullRange);
+      la_enqueue_kernel(la_kernel_ants_forward,
+                        cl::NDRange(ants.size()),
+                        cl::NullRange);
+    }
+    break;
+  case LA_ENGINE_PACKED:
+    if (ants.empty()) {
+      break;
+    }
+    for (size_t i = 0; i < k; ++i) {
+      la_enqueue_kernel(la_kernel_packed_ants_rotate,
+                        cl::NDRange(ants.size()),
+                        cl::NullRange);
+      la_enqueue_kernel(la_kernel_packed_ants_forward,
+                        cl::NDRange(ants.size()),
+                        cl::NullRange);
+    }
+    break;
+  case LA_ENGINE_CPU:
+    cpu_engine->step(k);
+    break;
+  case LA_ENGINE_STRIPS:
+    for (size_t i = 0; i < k; ++i) {
+      la_strips_step();
+    }
+    break;
+  }
+}
 
-    program = cl::Program(context, source_string);
-    try {
-      program.build();
-    } catch (const cl::Error& err) {
-      std::cout << "Build Status: "
-                << program.getBuildInfo<CL_PROGRAM_BUILD_STATUS>(
-                    context.getInfo<CL_CONTEXT_DEVICES>()[0]) << std::endl;
-      std::cout << "Build Options: "
-                << program.getBuildInfo<CL_PROGRAM_BUILD_OPTIONS>(
-                    context.getInfo<CL_CONTEXT_DEVICES>()[0]) << std::endl;
-      std::cout << "Build Log: "
-                << program.getBuildInfo<CL_PROGRAM_BUILD_LOG>(
-                    context.getInfo<CL_CONTEXT_DEVICES>()[0]) << std::endl;
-      throw err;
+/*
+  Draw the squares under the ants of the native engine
+  straight into rendered_texture.
+*/
+static void la_cpu_draw() {
+  glBindTexture(GL_TEXTURE_2D, rendered_texture);
+  if (first) {
+    const std::vector<GLubyte> white(
+        static_cast<size_t>(field_width) * field_height, PALETTE_UNSEEN);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, field_width, field_height,
+                    GL_RED, GL_UNSIGNED_BYTE, &white.front());
+    first = false;
+  }
+  static std::vector<la_ant> positions;
+  cpu_engine->ant_positions(positions);
+  for (const la_ant& a : positions) {
+    if (a.x >= field_width || a.y >= field_height) {
+      continue;
     }
-    la_kernel_rotate_and_flip = cl::Kernel(program, "la_rotate_and_flip");
-    la_kernel_rotate_and_flip.setArg(0, dev_field_in);
-    la_kernel_rotate_and_flip.setArg(1, dev_field_out);
+    const int colour = (a.c & BITS_COLOUR) >> COLOUR_SHIFT;
+    const GLubyte index = (colour > 1) ? PALETTE_COLOURS + colour - 2
+      : (colour != 0) ? PALETTE_BW_SET : PALETTE_BW_CLEAR;
+    glTexSubImage2D(GL_TEXTURE_2D, 0, a.x, a.y, 1, 1,
+                    GL_RED, GL_UNSIGNED_BYTE, &index);
+  }
+  glCheck_("glTexSubImage2D");
+}
 
-    la_kernel_forward = cl::Kernel(program, "la_forward");
-    la_kernel_forward.setArg(0, dev_field_out);
-    la_kernel_forward.setArg(1, dev_field_in);
+// zoom, translation and window size last handed over by the GL thread
+static la_view_params la_current_view() {
+  std::lock_guard<std::mutex> lock(frame_mutex);
+  return view_params;
+}
 
-    la_kernel_clear_image = cl::Kernel(program, "la_clear_image");
-    la_kernel_clear_image.setArg(0, dev_image);
+static bool la_same_view(const la_view_params& a, const la_view_params& b) {
+  return a.zoom == b.zoom && a.translate_x == b.translate_x
+    && a.translate_y == b.translate_y
+    && a.width == b.width && a.height == b.height;
+}
 
-    la_kernel_draw_image = cl::Kernel(program, "la_draw_image");
-    la_kernel_draw_image.setArg(0, dev_field_in);
-    la_kernel_draw_image.setArg(1, dev_image);
-    command_queue.enqueueWriteBuffer(
-        dev_field_in, CL_FALSE, 0,
-        sizeof(cl_char) * global_work_size[0] * global_work_size[1],
-        &field_init.front());
+/*
+  Draw the window at its own resolution (--lod) into the lower left
+  corner of the frame.
+*/
+static void la_enqueue_view() {
+  const la_view_params v = la_current_view();
+  view_drawn = v;
+  const int w = std::min(v.width, view_texture_width);
+  const int h = std::min(v.height, view_texture_height);
+  if (w <= 0 || h <= 0) {
+    return;
+  }
+  la_kernel_view.setArg(0, (engine == LA_ENGINE_PACKED)
+                        ? dev_field_packed : dev_field_in);
+  la_kernel_view.setArg(4, v.zoom);
+  la_kernel_view.setArg(5, v.translate_x);
+  la_kernel_view.setArg(6, v.translate_y);
+  la_enqueue_kernel(la_kernel_view, cl::NDRange(w, h), cl::NullRange);
+  if ((engine == LA_ENGINE_SPARSE || engine == LA_ENGINE_PACKED)
+      && !ants.empty()) {
+    la_kernel_view_ants.setArg(3, v.zoom);
+    la_kernel_view_ants.setArg(4, v.translate_x);
+    la_kernel_view_ants.setArg(5, v.translate_y);
+    la_kernel_view_ants.setArg(6, w);
+    la_kernel_view_ants.setArg(7, h);
+    la_enqueue_kernel(la_kernel_view_ants, cl::NDRange(ants.size()),
+                      cl::NullRange);
+  }
+}
 
-    startGL();
+static void la_enqueue_draw() {
+  if (lod) {
+    la_enqueue_view();
+    return;
+  }
+  switch (engine) {
+  case LA_ENGINE_DENSE:
+  case LA_ENGINE_FUSED:
+    la_kernel_draw_image.setArg(0, dev_field_in);
+    la_enqueue_kernel(la_kernel_draw_image,
+                      la_field_range(local_draw),
+                      local_draw);
+    break;
+  case LA_ENGINE_SPARSE:
+    if (ants.empty()) {
+      break;
+    }
+    la_enqueue_kernel(la_kernel_ants_draw_image,
+                      cl::NDRange(ants.size()),
+                      cl::NullRange);
+    break;
+  case LA_ENGINE_PACKED:
+    if (ants.empty()) {
+      break;
+    }
+    la_enqueue_kernel(la_kernel_packed_ants_draw_image,
+                      cl::NDRange(ants.size()),
+                      cl::NullRange);
+    break;
+  case LA_ENGINE_CPU:
+    la_cpu_draw();
+    break;
+  case LA_ENGINE_STRIPS:
+    break;
+  }
+}
+
+/*
+  Draw the current field into dev_frame, or straight into the texture for
+  the cpu engines.
+*/
+static void la_draw_frame() {
+  if (engine == LA_ENGINE_CPU) {
+    la_enqueue_draw();
+    ++frame_count;
+    return;
+  }
+  if (first && !lod) {
+    la_enqueue_kernel(la_kernel_clear_image,
+                      la_field_range(local_draw),
+                      local_draw);
+  }
+  first = false;
+  la_enqueue_draw();
+  command_queue.flush();
+  if (kernel_timing) {
+    la_collect_kernel_times();
+  }
+}
+
+/*
+  Hand the frame drawn so far to the GL thread by copying it into
+  dev_frame_front, after the GL thread's copy of the previous frame out of
+  it. Neither thread waits: the copies are ordered by their events.
+*/
+static void la_publish_frame() {
+  const std::array<size_t, 3> origin = {0, 0, 0};
+  std::lock_guard<std::mutex> lock(frame_mutex);
+  std::vector<cl::Event> wait;
+  if (shown_event() != 0) {
+    wait.push_back(shown_event);
+  }
+  command_queue.enqueueCopyImage(dev_frame, dev_frame_front,
+                                 origin, origin, la_frame_region(),
+                                 wait.empty() ? 0 : &wait, &frame_event);
+  command_queue.flush();
+  if (kernel_timing) {
+    la_record_event("publish_frame", frame_event);
+  }
+  frame_ready = true;
+}
+
+/*
+  Copy the latest published frame into the GL texture once its copy has
+  completed, else keep showing the previous one. Also hands the current
+  zoom, translation and window size to the compute thread. GL thread.
+*/
+static void la_show_frame() {
+  const std::array<size_t, 3> origin = {0, 0, 0};
+  {
+    std::lock_guard<std::mutex> lock(frame_mutex);
+    view_params = la_view_params{zoom, translate_x, translate_y,
+                                 view_width, view_height};
+    if (!frame_ready
+        || frame_event.getInfo<CL_EVENT_COMMAND_EXECUTION_STATUS>()
+           != CL_COMPLETE) {
+      return;
+    }
+    frame_ready = false;
+    std::vector<cl::Memory> dev_image_vec({dev_image});
+    la_enqueue_acquire_gl(render_queue, dev_image_vec);
+    render_queue.enqueueCopyImage(dev_frame_front, dev_image,
+                                  origin, origin, la_frame_region(),
+                                  0, &shown_event);
+    la_enqueue_release_gl(render_queue, dev_image_vec);
+  }
+  // a short copy; GL must not sample the texture before its release
+  render_queue.finish();
+  ++frame_count;
+}
+
+/*
+  Keep one batch in flight on command_queue: wait for the previous batch
+  only, so the device always has the next one queued.
+*/
+static void la_wait_previous_batch() {
+  cl::Event event;
+  command_queue.enqueueMarkerWithWaitList(0, &event);
+  command_queue.flush();
+  if (batch_pending) {
+    batch_event.wait();
+  }
+  batch_event = event;
+  batch_pending = true;
+}
+
+/*
+  Run one batch of generations and draw it, then the periodic work:
+  statistics, checkpoints, the adaptive batch size and the progress line.
+*/
+static void la_frame_step() {
+  const auto frame_start = std::chrono::steady_clock::now();
+  int k = (steps_per_frame > 0) ? steps_per_frame : adaptive_steps;
+  if (record_file) {
+    // every recorded frame falls on a multiple of the interval
+    k = std::min<size_t>(k, record_interval - step % record_interval);
+  }
+  la_enqueue_generations(k);
+  la_draw_frame();
+  if (engine != LA_ENGINE_CPU) {
+    la_wait_previous_batch();
+  }
+  step += k;
+  step_count += k;
+  if (engine != LA_ENGINE_CPU) {
+    la_poll_stats(false);
+    if (stats_interval > 0
+        && step / stats_interval != (step - k) / stats_interval) {
+      la_enqueue_stats();
+    }
+  }
+  if (checkpoint_interval > 0
+      && step / checkpoint_interval != (step - k) / checkpoint_interval) {
+    la_save_snapshot(save_file);
+  }
+  if (record_file && step % record_interval == 0) {
+    la_record_frame();
+  }
+
+  if (steps_per_frame == 0) {
+    // Choose the number of steps so that a batch takes refresh_mills.
+    // With one batch in flight, the time between two calls is that of
+    // a batch on the device.
+    const double elapsed = std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - frame_start).count();
+    const double scale = std::min(
+        2.0, std::max(0.5, refresh_mills / std::max(elapsed, 0.001)));
+    adaptive_steps =
+      std::max(1, static_cast<int>(lround(adaptive_steps * scale)));
+  }
+
+  const auto now = std::chrono::steady_clock::now();
+  const double seconds =
+    std::chrono::duration<double>(now - wall_clock).count();
+  if (seconds > 1.0) {
+    const double sps = step_count / seconds;
+    const double fps = frame_count.exchange(0) / seconds;
+    step_count = 0;
+    std::stringstream ss;
+    ss << "step[" << step << "],steps/s[" << sps << "],fps[" << fps << "]";
+    if (steps_per_frame == 0) {
+      ss << ",k[" << adaptive_steps << "]";
+    }
+    if (!stats_summary.empty()) {
+      ss << "," << stats_summary;
+    }
+    show_report(ss.str());
+    wall_clock = now;
+    la_profile_tick();
+  }
+  int expected = 2;
+  paused.compare_exchange_strong(expected, 1);
+}
+
+/*
+  Body of the compute thread of the OpenCL engines: batches as fast as
+  gen_mills allows, a frame published every refresh_mills and on pausing.
+  While paused, only the LOD view is redrawn, when the GL thread has
+  changed zoom, translation or window size.
+*/
+static void la_compute_loop() {
+  try {
+    auto published = std::chrono::steady_clock::now();
+    const auto refresh = std::chrono::milliseconds(refresh_mills);
+    while (!compute_quit) {
+      if (paused == 1) {
+        if (lod && !la_same_view(la_current_view(), view_drawn)) {
+          la_draw_frame();
+          la_publish_frame();
+        }
+        std::this_thread::sleep_for(refresh);
+        continue;
+      }
+      la_frame_step();
+      const auto now = std::chrono::steady_clock::now();
+      if (paused == 1 || now - published >= refresh) {
+        la_publish_frame();
+        published = now;
+      }
+      if (gen_mills > 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(gen_mills));
+      }
+    }
+    command_queue.finish();
+  } catch (const cl::Error& err) {
+    // rethrown by startGL
+    compute_error = std::current_exception();
+    compute_quit = true;
+  }
+}
+
+// cpu engines, which draw with GL, step on the GL thread
+static void generationTimer_cb(int dummy) {
+  if (paused != 1) {
+    la_frame_step();
+  }
+  glutTimerFunc(gen_mills, generationTimer_cb, 0);
+}
+
+static void displayTimer_cb(int dummy) {
+  if (compute_thread.joinable()) {
+    if (compute_quit) {
+      glutLeaveMainLoop();
+      return;
+    }
+    try {
+      la_show_frame();
+    } catch (const cl::Error& err) {
+      std::cerr << err.what() << std::endl;
+      throw;
+    }
+  }
+  glutPostRedisplay();
+  glutTimerFunc(refresh_mills, displayTimer_cb, 0);
+}
+
+static void startGL() {
+  glutTimerFunc(0, displayTimer_cb, 0);
+  if (engine == LA_ENGINE_CPU) {
+    glutTimerFunc(0, generationTimer_cb, 0);
+  } else {
+    compute_thread = std::thread(la_compute_loop);
+  }
+  glutMainLoop();
+  if (compute_thread.joinable()) {
+    compute_quit = true;
+    compute_thread.join();
+  }
+  if (compute_error) {
+    std::rethrow_exception(compute_error);
+  }
+}
+
+// ----------------------------------------------------------------------
+// utility function
+// ----------------------------------------------------------------------
+static bool la_read_file(const std::string& filename,
+                         std::vector<unsigned char>& content) {
+  std::ifstream ifs(filename, std::ios::binary);
+  if (!ifs) {
+    return false;
+  }
+  content.assign(std::istreambuf_iterator<char>(ifs),
+                 std::istreambuf_iterator<char>());
+  return true;
+}
+
+// ----------------------------------------------------------------------
+// game functions
+// ----------------------------------------------------------------------
+
+/*
+  Place count ants at random.
+  An ant placed on an occupied square replaces the earlier one.
+*/
+void la_init_random_ants(std::vector<la_ant>& ants, unsigned run_seed,
+                         int count) {
+  unsigned state = run_seed;
+  srand(run_seed);
+  std::vector<la_ant> placed;
+  for (int i = 0; i < count; ++i) {
+    int y = rand_r(&state) % field_height;
+    int x = rand_r(&state) % field_width;
+    int d = (1 << (rand_r(&state) % 4));
+    placed.push_back(la_ant{x, y, d, 0});
+  }
+  ants.clear();
+  std::unordered_set<int64_t> occupied;
+  for (auto it = placed.rbegin(); it != placed.rend(); ++it) {
+    if (occupied.insert(static_cast<int64_t>(it->y) << 32 | it->x).second) {
+      ants.push_back(*it);
+    }
+  }
+  std::sort(ants.begin(), ants.end(), [](const la_ant& a, const la_ant& b) {
+      return (a.y != b.y) ? (a.y < b.y) : (a.x < b.x);
+    });
+}
+
+/*
+  Put the ants into a field in the dense layout.
+*/
+void la_put_ants(std::vector<cl_char>& field,
+                 const std::vector<la_ant>& ants) {
+  for (const la_ant& a : ants) {
+    field[static_cast<size_t>(a.y) * field_width + a.x] |= a.d;
+  }
+}
+
+/*
+  Expand colour words (stride words per row, as in the packed engine)
+  into a field in the dense layout, without ants.
+*/
+void la_unpack_field(const cl_uint* words, cl_int stride,
+                     std::vector<cl_char>& field) {
+  field.resize(static_cast<size_t>(field_width) * field_height);
+  for (cl_int y = 0; y < field_height; ++y) {
+    for (cl_int x = 0; x < field_width; ++x) {
+      const cl_uint w = words[static_cast<size_t>(y) * stride + (x >> 5)];
+      field[static_cast<size_t>(y) * field_width + x] =
+        ((w >> (x & 31)) & 1) ? BIT_BW : 0;
+    }
+  }
+}
+
+/*
+  Index of square (x, y) in a byte field of the device, as field_index
+  in langtons_ant_kernel.cl.
+*/
+static size_t la_field_index(cl_int x, cl_int y) {
+  if (!field_tiles) {
+    return static_cast<size_t>(y) * field_stride + x;
+  }
+  const int mask = (1 << FIELD_TILE_SHIFT) - 1;
+  const size_t tile = static_cast<size_t>(y >> FIELD_TILE_SHIFT)
+    * (field_stride >> FIELD_TILE_SHIFT) + (x >> FIELD_TILE_SHIFT);
+  return (tile << (2 * FIELD_TILE_SHIFT))
+    | ((y & mask) << FIELD_TILE_SHIFT) | (x & mask);
+}
+
+// Bytes of a byte field on the device.
+static size_t la_field_bytes() {
+  return sizeof(cl_char) * field_stride * field_rows;
+}
+
+/*
+  Convert a byte field between rows on the host and the layout of the
+  device (to_device), in place. Nothing to do without --layout tiles.
+*/
+static void la_convert_layout(std::vector<cl_char>& field, bool to_device) {
+  if (!field_tiles) {
+    return;
+  }
+  std::vector<cl_char> converted(
+      to_device ? la_field_bytes()
+      : static_cast<size_t>(field_width) * field_height, 0);
+  size_t i = 0;
+  for (cl_int y = 0; y < field_height; ++y) {
+    for (cl_int x = 0; x < field_width; ++x, ++i) {
+      if (to_device) {
+        converted[la_field_index(x, y)] = field[i];
+      } else {
+        converted[i] = field[la_field_index(x, y)];
+      }
+    }
+  }
+  field.swap(converted);
+}
+
+/*
+  Read the colour words of the packed engine.
+*/
+void la_read_packed(std::vector<cl_uint>& words) {
+  words.resize(static_cast<size_t>(packed_stride) * field_height);
+  command_queue.enqueueReadBuffer(
+      dev_field_packed, CL_TRUE, 0,
+      sizeof(cl_uint) * words.size(), &words.front());
+}
+
+/*
+  Read the current field back in the dense layout
+  (direction bits and BIT_BW in every square).
+*/
+void la_read_field(std::vector<cl_char>& field) {
+  if (engine == LA_ENGINE_CPU) {
+    cpu_engine->read_field(field);
+    return;
+  }
+  if (engine == LA_ENGINE_STRIPS) {
+    field.resize(static_cast<size_t>(field_width) * field_height);
+    for (la_strip& s : strips) {
+      s.queue.enqueueReadBuffer(
+          s.field[strip_cur], CL_TRUE,
+          sizeof(cl_char) * field_width,
+          sizeof(cl_char) * field_width * s.rows,
+          &field[static_cast<size_t>(s.y0) * field_width]);
+    }
+    return;
+  }
+  if (engine == LA_ENGINE_PACKED) {
+    std::vector<cl_uint> words;
+    la_read_packed(words);
+    la_unpack_field(&words.front(), packed_stride, field);
+  } else {
+    field.resize(la_field_bytes());
+    command_queue.enqueueReadBuffer(
+        dev_field_in, CL_TRUE, 0, field.size(), &field.front());
+    la_convert_layout(field, false);
+  }
+  if ((engine == LA_ENGINE_SPARSE || engine == LA_ENGINE_PACKED)
+      && !ants.empty()) {
+    command_queue.enqueueReadBuffer(
+        dev_ants, CL_TRUE, 0,
+        sizeof(la_ant) * ants.size(), &ants.front());
+    for (const la_ant& a : ants) {
+      field[static_cast<size_t>(a.y) * field_width + a.x] |= a.d;
+    }
+  }
+}
+
+/*
+  Write the field as a binary PGM image:
+  white squares are 255, black squares 0 and squares with ants 128.
+  The colours of a --rule go from 255 (colour 0) down to 0.
+*/
+void la_write_pgm(const char *filename, const std::vector<cl_char>& field) {
+  std::ofstream ofs(filename, std::ios::binary);
+  ofs << "P5\n" << field_width << " " << field_height << "\n255\n";
+  std::vector<unsigned char> row(field_width);
+  for (cl_int y = 0; y < field_height; ++y) {
+    for (cl_int x = 0; x < field_width; ++x) {
+      const cl_char c = field[static_cast<size_t>(y) * field_width + x];
+      const int colour = (c & BITS_COLOUR) >> COLOUR_SHIFT;
+      row[x] = ((c & BITS_NEWS) != 0) ? 128
+        : 255 - 255 * colour / (rule.colours - 1);
+    }
+    ofs.write(reinterpret_cast<const char*>(&row.front()), row.size());
+  }
+  if (!ofs) {
+    std::cerr << "failed to write " << filename << std::endl;
+  }
+}
+
+/*
+  Bytes of the field buffer copied per frame: one per square, or the
+  colour words of the packed engine.
+*/
+static size_t la_record_field_size() {
+  if (engine == LA_ENGINE_PACKED) {
+    return sizeof(cl_uint) * packed_stride * field_height;
+  }
+  return la_field_bytes();
+}
+
+/*
+  Writer thread: wait for the reads of slot, rebuild the field in the
+  dense layout and write it in record_format.
+*/
+static void la_record_write(la_record_slot& slot) {
+  std::vector<cl_char> field;
+  if (engine == LA_ENGINE_CPU) {
+    field.swap(slot.host_field);
+  } else {
+    slot.event.wait();
+    if (engine == LA_ENGINE_PACKED) {
+      la_unpack_field(static_cast<const cl_uint*>(slot.field),
+                      packed_stride, field);
+    } else {
+      const cl_char* p = static_cast<const cl_char*>(slot.field);
+      field.assign(p, p + la_record_field_size());
+      la_convert_layout(field, false);
+    }
+    if (slot.ants != 0) {
+      la_put_ants(field, std::vector<la_ant>(slot.ants,
+                                             slot.ants + ants.size()));
+    }
+  }
+  switch (record_format) {
+  case RECORD_RAW:
+    record_out.write(reinterpret_cast<const char*>(&slot.step),
+                     sizeof(uint64_t));
+    record_out.write(reinterpret_cast<const char*>(&field.front()),
+                     field.size());
+    break;
+  case RECORD_DELTA:
+    {
+      // step, number of runs, then per run the squares skipped since the
+      // previous run, its length and its bytes
+      if (record_previous.empty()) {
+        record_previous.assign(field.size(), 0);
+      }
+      std::vector<char> runs;
+      uint32_t n_runs = 0;
+      size_t end = 0;  // of the previous run
+      for (size_t i = 0; i < field.size();) {
+        if (field[i] == record_previous[i]) {
+          ++i;
+          continue;
+        }
+        size_t j = i;
+        while (j < field.size() && field[j] != record_previous[j]) {
+          ++j;
+        }
+        const uint32_t head[2] = {static_cast<uint32_t>(i - end),
+                                  static_cast<uint32_t>(j - i)};
+        runs.insert(runs.end(), reinterpret_cast<const char*>(head),
+                    reinterpret_cast<const char*>(head + 2));
+        runs.insert(runs.end(), &field[i], &field[0] + j);
+        ++n_runs;
+        end = i = j;
+      }
+      record_out.write(reinterpret_cast<const char*>(&slot.step),
+                       sizeof(uint64_t));
+      record_out.write(reinterpret_cast<const char*>(&n_runs),
+                       sizeof(n_runs));
+      if (!runs.empty()) {
+        record_out.write(&runs.front(), runs.size());
+      }
+      record_previous.swap(field);
+    }
+    break;
+  case RECORD_PGM:
+    {
+      // name.pgm -> name.<step>.pgm
+      std::string name(record_file);
+      name.erase(name.size() - 4);
+      char suffix[32];
+      snprintf(suffix, sizeof(suffix), ".%010llu.pgm",
+               static_cast<unsigned long long>(slot.step));
+      la_write_pgm((name + suffix).c_str(), field);
+    }
+    break;
+  case RECORD_ANTS:
+    {
+      std::vector<la_ant> positions;
+      la_extract_ants(field, field_width, field_height, positions);
+      for (size_t i = 0; i < positions.size(); ++i) {
+        const la_ant& a = positions[i];
+        record_out << slot.step << "," << i << "," << a.x << "," << a.y
+                   << "," << a.d << "\n";
+      }
+    }
+    break;
+  }
+}
+
+/*
+  Open the record file, allocate and map the pinned slots and start the
+  writer thread. After initCL.
+*/
+static void initRecord() {
+  const std::string name(record_file);
+  if (record_format != RECORD_PGM) {
+    record_out.open(record_file, std::ios::binary);
+    if (!record_out) {
+      std::cerr << "failed to open " << record_file << std::endl;
+      exit(1);
+    }
+  }
+  if (record_format == RECORD_RAW || record_format == RECORD_DELTA) {
+    // magic, width and height
+    const cl_int size[2] = {field_width, field_height};
+    record_out.write((record_format == RECORD_RAW) ? "LARECRAW" : "LARECDLT",
+                     8);
+    record_out.write(reinterpret_cast<const char*>(size), sizeof(size));
+  } else if (record_format == RECORD_ANTS) {
+    record_out << "step,ant,x,y,d" << std::endl;
+  }
+  const size_t n_ants =
+    (engine == LA_ENGINE_SPARSE || engine == LA_ENGINE_PACKED)
+    ? ants.size() : 0;
+  for (la_record_slot& slot : record_slots) {
+    slot.busy = false;
+    slot.field = 0;
+    slot.ants = 0;
+    if (engine == LA_ENGINE_CPU) {
+      continue;
+    }
+    slot.pinned_field = cl::Buffer(
+        context, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR,
+        la_record_field_size());
+    slot.field = command_queue.enqueueMapBuffer(
+        slot.pinned_field, CL_TRUE, CL_MAP_READ | CL_MAP_WRITE,
+        0, la_record_field_size());
+    if (n_ants > 0) {
+      slot.pinned_ants = cl::Buffer(
+          context, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR,
+          sizeof(la_ant) * n_ants);
+      slot.ants = static_cast<la_ant*>(command_queue.enqueueMapBuffer(
+          slot.pinned_ants, CL_TRUE, CL_MAP_READ | CL_MAP_WRITE,
+          0, sizeof(la_ant) * n_ants));
+    }
+  }
+  record_thread = std::thread([] {
+      for (;;) {
+        int i;
+        {
+          std::unique_lock<std::mutex> lock(record_mutex);
+          record_cv.wait(lock, [] {
+              return record_done || !record_queue.empty();
+            });
+          if (record_queue.empty()) {
+            return;
+          }
+          i = record_queue.front();
+          record_queue.pop_front();
+        }
+        la_record_write(record_slots[i]);
+        {
+          std::lock_guard<std::mutex> lock(record_mutex);
+          record_slots[i].busy = false;
+        }
+        record_cv.notify_all();
+      }
+    });
+}
+
+/*
+  Record the current field: enqueue non-blocking reads into the next
+  slot after the generations already enqueued, and hand it to the writer
+  thread. Waits only if the writer still holds every slot.
+*/
+static void la_record_frame() {
+  la_record_slot& slot = record_slots[record_next];
+  {
+    std::unique_lock<std::mutex> lock(record_mutex);
+    if (slot.busy) {
+      const auto start = std::chrono::steady_clock::now();
+      record_cv.wait(lock, [&slot] { return !slot.busy; });
+      record_wait += std::chrono::duration<double>(
+          std::chrono::steady_clock::now() - start).count();
+    }
+  }
+  slot.step = step;
+  if (engine == LA_ENGINE_CPU) {
+    cpu_engine->read_field(slot.host_field);
+  } else {
+    const cl::Buffer& src = (engine == LA_ENGINE_PACKED)
+      ? dev_field_packed : dev_field_in;
+    if (slot.ants != 0) {
+      command_queue.enqueueReadBuffer(src, CL_FALSE, 0,
+                                      la_record_field_size(), slot.field);
+      command_queue.enqueueReadBuffer(dev_ants, CL_FALSE, 0,
+                                      sizeof(la_ant) * ants.size(),
+                                      slot.ants, 0, &slot.event);
+    } else {
+      command_queue.enqueueReadBuffer(src, CL_FALSE, 0,
+                                      la_record_field_size(), slot.field,
+                                      0, &slot.event);
+    }
+    command_queue.flush();
+  }
+  {
+    std::lock_guard<std::mutex> lock(record_mutex);
+    slot.busy = true;
+    record_queue.push_back(record_next);
+  }
+  record_cv.notify_all();
+  record_next = (record_next + 1) % RECORD_SLOTS;
+  ++record_frames;
+}
+
+/*
+  Let the writer finish the frames in flight, then unmap the slots.
+*/
+static void endRecord() {
+  {
+    std::lock_guard<std::mutex> lock(record_mutex);
+    record_done = true;
+  }
+  record_cv.notify_all();
+  record_thread.join();
+  for (la_record_slot& slot : record_slots) {
+    if (slot.field != 0) {
+      command_queue.enqueueUnmapMemObject(slot.pinned_field, slot.field);
+    }
+    if (slot.ants != 0) {
+      command_queue.enqueueUnmapMemObject(slot.pinned_ants, slot.ants);
+    }
+  }
+  if (engine != LA_ENGINE_CPU) {
+    command_queue.finish();
+  }
+  record_out.close();
+  std::cout << "record[" << record_file << "],frames[" << record_frames
+            << "],wait[" << record_wait << "]" << std::endl;
+}
+
+// ----------------------------------------------------------------------
+// snapshots
+// ----------------------------------------------------------------------
+
+/*
+  Snapshot file, in host byte order:
+    la_snapshot_header
+    la_ant ants[n_ants], c unused
+    zero padding up to words_offset, a multiple of the page size
+    cl_uint words[stride * height], colours as in the packed engine
+  The words can be uploaded straight from the mapped file.
+*/
+static const char LA_SNAPSHOT_MAGIC[8] = {
+  'L', 'A', 'N', 'T', 'S', 'N', 'A', 'P'};
+static const uint32_t LA_SNAPSHOT_VERSION = 1;
+static const uint64_t LA_SNAPSHOT_ALIGN = 4096;
+
+struct la_snapshot_header {
+  char magic[8];
+  uint32_t version;
+  int32_t width;
+  int32_t height;
+  int32_t stride;          // 32-bit words per row
+  uint64_t step;
+  uint64_t seed;
+  uint64_t n_ants;
+  uint64_t words_offset;   // file offset of the colour words
+  uint64_t reserved;
+};
+static_assert(sizeof(la_snapshot_header) == 64,
+              "la_snapshot_header must not be padded");
+
+// a snapshot mapped into memory
+struct la_snapshot {
+  void* map;
+  size_t size;
+  const la_snapshot_header* header;
+  const la_ant* ants;
+  const cl_uint* words;
+};
+
+/*
+  Write the current state to filename. The file is written next to it
+  first and renamed, so an interrupted save keeps the previous snapshot.
+*/
+static void la_save_snapshot(const char* filename) {
+  const cl_int stride = (field_width + 31) / 32;
+  std::vector<cl_uint> words;
+  std::vector<la_ant> snapshot_ants;
+  if (engine == LA_ENGINE_PACKED) {
+    la_read_packed(words);
+    if (!ants.empty()) {
+      command_queue.enqueueReadBuffer(
+          dev_ants, CL_TRUE, 0,
+          sizeof(la_ant) * ants.size(), &ants.front());
+    }
+    snapshot_ants = ants;
+  } else {
+    std::vector<cl_char> field;
+    la_read_field(field);
+    la_extract_ants(field, field_width, field_height, snapshot_ants);
+    words.assign(static_cast<size_t>(stride) * field_height, 0);
+    for (cl_int y = 0; y < field_height; ++y) {
+      for (cl_int x = 0; x < field_width; ++x) {
+        if ((field[static_cast<size_t>(y) * field_width + x]
+             & BIT_BW) != 0) {
+          words[static_cast<size_t>(y) * stride + (x >> 5)] |=
+            1u << (x & 31);
+        }
+      }
+    }
+  }
+
+  la_snapshot_header header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, LA_SNAPSHOT_MAGIC, sizeof(header.magic));
+  header.version = LA_SNAPSHOT_VERSION;
+  header.width = field_width;
+  header.height = field_height;
+  header.stride = stride;
+  header.step = step;
+  header.seed = seed;
+  header.n_ants = snapshot_ants.size();
+  const uint64_t ants_end =
+    sizeof(header) + sizeof(la_ant) * snapshot_ants.size();
+  header.words_offset = (ants_end + LA_SNAPSHOT_ALIGN - 1)
+    / LA_SNAPSHOT_ALIGN * LA_SNAPSHOT_ALIGN;
+
+  const std::string tmp = std::string(filename) + ".tmp";
+  std::ofstream ofs(tmp, std::ios::binary);
+  ofs.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  if (!snapshot_ants.empty()) {
+    ofs.write(reinterpret_cast<const char*>(&snapshot_ants.front()),
+              sizeof(la_ant) * snapshot_ants.size());
+  }
+  const std::vector<char> padding(header.words_offset - ants_end, 0);
+  ofs.write(padding.data(), padding.size());
+  ofs.write(reinterpret_cast<const char*>(&words.front()),
+            sizeof(cl_uint) * words.size());
+  ofs.close();
+  if (!ofs || rename(tmp.c_str(), filename) != 0) {
+    std::cerr << "failed to write " << filename << std::endl;
+    return;
+  }
+  std::cout << "saved step[" << step << "] to " << filename << std::endl;
+}
+
+/*
+  Map a snapshot read-only and check it. Exits on a bad file.
+*/
+static void la_map_snapshot(const char* filename, la_snapshot& snapshot) {
+  const int fd = open(filename, O_RDONLY);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) != 0) {
+    std::cerr << "cannot open " << filename << std::endl;
+    exit(1);
+  }
+  snapshot.size = st.st_size;
+  snapshot.map = (snapshot.size < sizeof(la_snapshot_header)) ? MAP_FAILED
+    : mmap(0, snapshot.size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (snapshot.map == MAP_FAILED) {
+    std::cerr << "cannot map " << filename << std::endl;
+    exit(1);
+  }
+  const char* base = static_cast<const char*>(snapshot.map);
+  const la_snapshot_header* h =
+    reinterpret_cast<const la_snapshot_header*>(base);
+  snapshot.header = h;
+  const char* problem = 0;
+  if (memcmp(h->magic, LA_SNAPSHOT_MAGIC, sizeof(h->magic)) != 0) {
+    problem = "not a snapshot";
+  } else if (h->version != LA_SNAPSHOT_VERSION) {
+    problem = "unsupported version";
+  } else if (h->width <= 0 || h->height <= 0
+             || h->stride != (h->width + 31) / 32) {
+    problem = "bad field size";
+  } else if (h->words_offset < sizeof(*h) + sizeof(la_ant) * h->n_ants
+             || h->words_offset % sizeof(cl_uint) != 0
+             || h->words_offset + sizeof(cl_uint)
+                * static_cast<uint64_t>(h->stride) * h->height
+                > snapshot.size) {
+    problem = "truncated";
+  }
+  if (problem) {
+    std::cerr << filename << ": " << problem << std::endl;
+    exit(1);
+  }
+  snapshot.ants = reinterpret_cast<const la_ant*>(base + sizeof(*h));
+  snapshot.words = reinterpret_cast<const cl_uint*>(base + h->words_offset);
+}
+
+static void la_unmap_snapshot(la_snapshot& snapshot) {
+  munmap(snapshot.map, snapshot.size);
+  snapshot.map = 0;
+}
+
+inline void rtrim(std::string &s) {
+    s.erase(std::find_if(s.rbegin(), s.rend(), [](unsigned char ch) {
+        return !std::isspace(ch);
+    }).base(), s.end());
+}
+
+bool with_cl_gl_sharing(const std::string& extensions) {
+  std::stringstream ex_ss(extensions);
+  std::string ex_item;
+  while (std::getline(ex_ss, ex_item, ' ')) {
+    if (ex_item == "cl_khr_gl_sharing") {
+      return true;
+    }
+  }
+  return false;
+}
+
+// ----------------------------------------------------------------------
+// cl setup
+// ----------------------------------------------------------------------
+
+/*
+  Devices in the order numbered by -d: the CPUs then the GPUs of every
+  platform, leaving out those without GL sharing unless headless.
+  Selected devices are marked with '*' in the list printed.
+*/
+static std::vector<cl::Device> la_list_devices(
+    const std::vector<size_t>& selected) {
+  std::vector<cl::Platform> platforms;
+  std::vector<cl::Device> result;
+  cl::Platform::get(&platforms);
+  for (cl::Platform& plat : platforms) {
+    for (cl_device_type device_type
+           : {CL_DEVICE_TYPE_CPU, CL_DEVICE_TYPE_GPU}) {
+      std::vector<cl::Device> devices;
+      plat.getDevices(device_type, &devices);
+      for (cl::Device& dev : devices) {
+        const std::string extensions = dev.getInfo<CL_DEVICE_EXTENSIONS>();
+        if (!headless && !with_cl_gl_sharing(extensions)) {
+          continue;
+        }
+        const size_t dev_index = result.size();
+        const std::string devvendor = dev.getInfo<CL_DEVICE_VENDOR>();
+        const std::string devname = dev.getInfo<CL_DEVICE_NAME>();
+        const std::string devver = dev.getInfo<CL_DEVICE_VERSION>();
+        const bool mark = std::find(selected.begin(), selected.end(),
+                                    dev_index) != selected.end();
+        std::cout << (mark ? '*' : ' ') <<
+          "device[" << dev_index << "]: vendor[" << devvendor << "]"
+          ",name[" << devname << "]"
+          ",version[" << devver << "]" << std::endl;
+        result.push_back(dev);
+      }
+    }
+  }
+  for (const size_t index : selected) {
+    if (index >= result.size()) {
+      std::cerr << "device[" << index << "] not found" << std::endl;
+      exit(1);
+    }
+  }
+  return result;
+}
+
+/*
+  Options the kernels are built with: a rule other than RL selects the
+  multi-colour rotate_and_flip and ant_rotate, specialised for it, and
+  --layout tiles the tiled field_index.
+*/
+static std::string la_build_options() {
+  std::stringstream ss;
+  if (!la_rule_is_rl(rule)) {
+    ss << "-D LA_RULE_COLOURS=" << rule.colours
+       << " -D LA_RULE_TURNS=" << rule.turns << "u";
+  }
+  if (field_tiles) {
+    ss << (la_rule_is_rl(rule) ? "" : " ") << "-D LA_FIELD_TILES";
+  }
+  return ss.str();
+}
+
+/*
+  File of the program binary for dev in the cache directory
+  ($XDG_CACHE_HOME or ~/.cache, then PROGRAM_CACHE_DIR), named after an
+  FNV-1a hash of the device, the driver and platform versions and the
+  source, so that a driver update or a kernel change misses the cache.
+  Empty if there is no cache directory.
+*/
+static std::string la_program_cache_file(const cl::Device& dev) {
+  std::string base;
+  if (getenv("XDG_CACHE_HOME")) {
+    base = getenv("XDG_CACHE_HOME");
+  } else if (getenv("HOME")) {
+    base = std::string(getenv("HOME")) + "/.cache";
+  } else {
+    return "";
+  }
+  const std::string dir = base + "/" + PROGRAM_CACHE_DIR;
+  mkdir(base.c_str(), 0755);
+  mkdir(dir.c_str(), 0755);
+  const cl::Platform plat(dev.getInfo<CL_DEVICE_PLATFORM>());
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for (const std::string& part : {
+      dev.getInfo<CL_DEVICE_NAME>(), dev.getInfo<CL_DEVICE_VERSION>(),
+      dev.getInfo<CL_DRIVER_VERSION>(), plat.getInfo<CL_PLATFORM_VERSION>(),
+      std::string(kernel_source), la_build_options()}) {
+    // the terminating 0 separates the parts
+    for (size_t i = 0; i <= part.size(); ++i) {
+      hash = (hash ^ static_cast<unsigned char>(part.c_str()[i]))
+        * 0x100000001b3ULL;
+    }
+  }
+  char name[32];
+  snprintf(name, sizeof(name), "%016llx.bin",
+           static_cast<unsigned long long>(hash));
+  return dir + "/" + name;
+}
+
+/*
+  The program built from the cached binary of the single device of ctx,
+  false if there is none or the driver rejects it.
+*/
+static bool la_load_program_binary(const cl::Context& ctx,
+                                   const std::string& filename,
+                                   cl::Program& prog) {
+  const std::vector<cl::Device> devices = ctx.getInfo<CL_CONTEXT_DEVICES>();
+  cl::Program::Binaries binaries(1);
+  if (filename.empty() || devices.size() != 1
+      || !la_read_file(filename, binaries[0]) || binaries[0].empty()) {
+    return false;
+  }
+  try {
+    prog = cl::Program(ctx, devices, binaries);
+    prog.build(la_build_options().c_str());
+  } catch (const cl::Error& err) {
+    std::cerr << "ignoring the cached program " << filename << ": "
+              << err.what() << "(" << err.err() << ")" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+static void la_save_program_binary(const cl::Program& prog,
+                                   const std::string& filename) {
+  const cl::Program::Binaries binaries =
+    prog.getInfo<CL_PROGRAM_BINARIES>();
+  if (filename.empty() || binaries.size() != 1 || binaries[0].empty()) {
+    return;
+  }
+  // written aside and renamed, so that concurrent runs never read half
+  // a binary
+  const std::string tmp = filename + "." + std::to_string(getpid());
+  std::ofstream ofs(tmp, std::ios::binary);
+  ofs.write(reinterpret_cast<const char*>(&binaries[0].front()),
+            binaries[0].size());
+  ofs.close();
+  if (!ofs || rename(tmp.c_str(), filename.c_str()) != 0) {
+    unlink(tmp.c_str());
+  }
+}
+
+/*
+  Build the kernels for the devices of ctx, printing the log on failure.
+  A context with a single device takes the program binary from the cache
+  when it can, and stores it there after building from the source.
+*/
+static cl::Program la_build_program(const cl::Context& ctx) {
+  const auto start = std::chrono::steady_clock::now();
+  const std::vector<cl::Device> devices = ctx.getInfo<CL_CONTEXT_DEVICES>();
+  const std::string cache_file =
+    (devices.size() == 1) ? la_program_cache_file(devices[0]) : "";
+  cl::Program prog;
+  if (la_load_program_binary(ctx, cache_file, prog)) {
+    std::cout << "program[cache],ms["
+              << std::chrono::duration<double, std::milli>(
+                  std::chrono::steady_clock::now() - start).count()
+              << "]" << std::endl;
+    return prog;
+  }
+
+  prog = cl::Program(ctx, std::string(kernel_source));
+  try {
+    prog.build(la_build_options().c_str());
+  } catch (const cl::Error& err) {
+    std::cout << "Build Status: "
+              << prog.getBuildInfo<CL_PROGRAM_BUILD_STATUS>(
+                  ctx.getInfo<CL_CONTEXT_DEVICES>()[0]) << std::endl;
+    std::cout << "Build Options: "
+              << prog.getBuildInfo<CL_PROGRAM_BUILD_OPTIONS>(
+                  ctx.getInfo<CL_CONTEXT_DEVICES>()[0]) << std::endl;
+    std::cout << "Build Log: "
+              << prog.getBuildInfo<CL_PROGRAM_BUILD_LOG>(
+                  ctx.getInfo<CL_CONTEXT_DEVICES>()[0]) << std::endl;
+    throw err;
+  }
+  la_save_program_binary(prog, cache_file);
+  std::cout << "program[source],ms["
+            << std::chrono::duration<double, std::milli>(
+                std::chrono::steady_clock::now() - start).count()
+            << "]" << std::endl;
+  return prog;
+}
+
+// ----------------------------------------------------------------------
+// work-group size autotuning
+// ----------------------------------------------------------------------
+static const char TUNE_FILE[] = "langtons_ant.tune";
+static const cl_int TUNE_FIELD = 2048;  // largest side of the scratch field
+static const int TUNE_RUNS = 20;        // timed launches per candidate
+static const size_t TUNE_MAX_SIDE = 64;
+
+static std::string la_range_string(const cl::NDRange& r) {
+  std::stringstream ss;
+  if (r.dimensions() == 0) {
+    ss << "auto";
+  } else {
+    ss << r.get()[0] << "x" << r.get()[1];
+  }
+  return ss.str();
+}
+
+// the local tile of la_step_fused for the work-group size local
+static cl::LocalSpaceArg la_tile_size(const cl::NDRange& local) {
+  return cl::Local(sizeof(cl_uchar)
+                   * (local.get()[0] + 2) * (local.get()[1] + 2));
+}
+
+/*
+  Whether the device can run kernel with the work-group size local on
+  the field; tile adds the local memory of la_step_fused.
+*/
+static bool la_local_fits(const cl::Kernel& kernel, const cl::NDRange& local,
+                          bool tile) {
+  if (local.dimensions() == 0) {
+    return !tile;
+  }
+  const size_t w = local.get()[0];
+  const size_t h = local.get()[1];
+  const std::vector<size_t> max_items =
+    device.getInfo<CL_DEVICE_MAX_WORK_ITEM_SIZES>();
+  if (w * h > kernel.getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(device)
+      || w > max_items[0] || h > max_items[1]) {
+    return false;
+  }
+  return !tile
+    || sizeof(cl_uchar) * (w + 2) * (h + 2)
+       + kernel.getWorkGroupInfo<CL_KERNEL_LOCAL_MEM_SIZE>(device)
+       <= device.getInfo<CL_DEVICE_LOCAL_MEM_SIZE>();
+}
+
+/*
+  Seconds for TUNE_RUNS launches of kernel over the scratch field, after
+  one launch to warm up, or a negative value if the launch fails.
+*/
+static double la_time_local(cl::Kernel& kernel, const cl::NDRange& scratch,
+                            const cl::NDRange& local, bool tile) {
+  const cl::NDRange global =
+    la_field_range(local, scratch.get()[0], scratch.get()[1]);
+  try {
+    if (tile) {
+      kernel.setArg(2, la_tile_size(local));
+    }
+    command_queue.enqueueNDRangeKernel(kernel, cl::NullRange, global, local);
+    command_queue.finish();
+    const auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < TUNE_RUNS; ++i) {
+      command_queue.enqueueNDRangeKernel(kernel, cl::NullRange, global,
+                                         local);
+    }
+    command_queue.finish();
+    return std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+  } catch (const cl::Error& err) {
+    return -1.0;
+  }
+}
+
+/*
+  The cached work-group size of kernel on the device, one line per
+  device, kernel and build options in TUNE_FILE: device name, kernel
+  name, la_build_options() and WxH (or auto for cl::NullRange),
+  separated by tabs. The options are part of the key as the layout and
+  the rule change the memory accesses of the kernels.
+*/
+static bool la_read_tune_cache(const std::string& dev_name,
+                               const std::string& kernel_name,
+                               const std::string& options,
+                               cl::NDRange& local) {
+  std::ifstream ifs(TUNE_FILE);
+  std::string line;
+  while (std::getline(ifs, line)) {
+    std::stringstream ss(line);
+    std::string d, k, o, size;
+    if (!std::getline(ss, d, '\t') || !std::getline(ss, k, '\t')
+        || !std::getline(ss, o, '\t') || !std::getline(ss, size)
+        || d != dev_name || k != kernel_name || o != options) {
+      continue;
+    }
+    size_t w, h;
+    if (size == "auto") {
+      local = cl::NullRange;
+      return true;
+    } else if (sscanf(size.c_str(), "%zux%zu", &w, &h) == 2) {
+      local = cl::NDRange(w, h);
+      return true;
+    }
+  }
+  return false;
+}
+
+static void la_write_tune_cache(const std::string& dev_name,
+                                const std::string& kernel_name,
+                                const std::string& options,
+                                const cl::NDRange& local) {
+  const std::string prefix =
+    dev_name + "\t" + kernel_name + "\t" + options + "\t";
+  std::vector<std::string> lines;
+  {
+    std::ifstream ifs(TUNE_FILE);
+    std::string line;
+    while (std::getline(ifs, line)) {
+      if (line.compare(0, prefix.size(), prefix) != 0) {
+        lines.push_back(line);
+      }
+    }
+  }
+  lines.push_back(prefix + la_range_string(local));
+  std::ofstream ofs(TUNE_FILE);
+  for (const std::string& line : lines) {
+    ofs << line << std::endl;
+  }
+  if (!ofs) {
+    std::cerr << "failed to write " << TUNE_FILE << std::endl;
+  }
+}
+
+/*
+  Pick the work-group size of kernel: the cached one if it still fits,
+  else the fastest of cl::NullRange (unless tile) and the powers of two
+  up to TUNE_MAX_SIDE a side that fit, timed on the scratch field.
+*/
+static cl::NDRange la_tune_kernel(cl::Kernel& kernel, bool tile,
+                                  const cl::NDRange& scratch) {
+  const std::string dev_name = device.getInfo<CL_DEVICE_NAME>();
+  const std::string kernel_name = kernel.getInfo<CL_KERNEL_FUNCTION_NAME>();
+  const std::string options = la_build_options();
+  cl::NDRange best;
+  if (la_read_tune_cache(dev_name, kernel_name, options, best)
+      && la_local_fits(kernel, best, tile)) {
+    std::cout << kernel_name << ": local[" << la_range_string(best)
+              << "] from " << TUNE_FILE << std::endl;
+    return best;
+  }
+  std::vector<cl::NDRange> candidates;
+  if (!tile) {
+    candidates.push_back(cl::NullRange);
+  }
+  for (size_t w = 1; w <= TUNE_MAX_SIDE; w *= 2) {
+    for (size_t h = 1; h <= TUNE_MAX_SIDE; h *= 2) {
+      // narrower groups than 4 squares only waste memory transactions
+      if (w >= 4 && la_local_fits(kernel, cl::NDRange(w, h), tile)) {
+        candidates.push_back(cl::NDRange(w, h));
+      }
+    }
+  }
+  double best_time = -1.0;
+  for (const cl::NDRange& local : candidates) {
+    const double t = la_time_local(kernel, scratch, local, tile);
+    if (t >= 0.0 && (best_time < 0.0 || t < best_time)) {
+      best = local;
+      best_time = t;
+    }
+  }
+  if (best_time < 0.0) {
+    std::cerr << kernel_name << ": no work-group size runs on this device"
+              << std::endl;
+    exit(1);
+  }
+  std::cout << kernel_name << ": local[" << la_range_string(best) << "]"
+            << " (" << candidates.size() << " candidates)" << std::endl;
+  la_write_tune_cache(dev_name, kernel_name, options, best);
+  return best;
+}
+
+/*
+  Set the width, height and stride of a field kernel, from argument
+  index first on.
+*/
+static void la_set_field_args(cl::Kernel& kernel, cl_uint first,
+                              cl_int width = field_width,
+                              cl_int height = field_height,
+                              cl_int stride = field_stride) {
+  kernel.setArg(first, width);
+  kernel.setArg(first + 1, height);
+  kernel.setArg(first + 2, stride);
+}
+
+/*
+  Tune the field kernels of the dense and fused engines on a scratch
+  field of at most TUNE_FIELD squares a side, so that the real field is
+  untouched and large fields tune as fast as small ones. The draw
+  kernels take the size of the step kernel when it fits them.
+*/
+static void la_autotune() {
+  // sparse and packed launch their ant kernels with cl::NullRange, so
+  // only the draw kernels would use a size: leave it to the driver
+  if (engine != LA_ENGINE_DENSE && engine != LA_ENGINE_FUSED) {
+    local_work_size = std::vector<cl_int>({0, 0});
+    local_draw = cl::NullRange;
+    return;
+  }
+  // whole tiles, as TUNE_FIELD is a multiple of them
+  const cl_int tw = std::min(field_stride, TUNE_FIELD);
+  const cl_int th = std::min(field_rows, TUNE_FIELD);
+  const size_t bytes = sizeof(cl_char) * tw * th;
+  const cl::NDRange scratch(tw, th);
+  cl::Buffer a(context, CL_MEM_READ_WRITE, bytes);
+  cl::Buffer b(context, CL_MEM_READ_WRITE, bytes);
+  command_queue.enqueueFillBuffer(a, cl_char(0), 0, bytes);
+  command_queue.enqueueFillBuffer(b, cl_char(0), 0, bytes);
+  cl::NDRange step_local;
+  switch (engine) {
+  case LA_ENGINE_DENSE:
+    la_kernel_rotate_and_flip.setArg(0, a);
+    la_kernel_rotate_and_flip.setArg(1, b);
+    la_kernel_forward.setArg(0, b);
+    la_kernel_forward.setArg(1, a);
+    la_set_field_args(la_kernel_rotate_and_flip, 2, tw, th, tw);
+    la_set_field_args(la_kernel_forward, 2, tw, th, tw);
+    local_rotate_and_flip =
+      la_tune_kernel(la_kernel_rotate_and_flip, false, scratch);
+    local_forward = la_tune_kernel(la_kernel_forward, false, scratch);
+    la_kernel_rotate_and_flip.setArg(0, dev_field_in);
+    la_kernel_rotate_and_flip.setArg(1, dev_field_out);
+    la_kernel_forward.setArg(0, dev_field_out);
+    la_kernel_forward.setArg(1, dev_field_in);
+    la_set_field_args(la_kernel_rotate_and_flip, 2);
+    la_set_field_args(la_kernel_forward, 2);
+    step_local = local_rotate_and_flip;
+    break;
+  case LA_ENGINE_FUSED:
+    // the buffers are set before every step
+    la_kernel_step_fused.setArg(0, a);
+    la_kernel_step_fused.setArg(1, b);
+    la_set_field_args(la_kernel_step_fused, 3, tw, th, tw);
+    local_step_fused = la_tune_kernel(la_kernel_step_fused, true, scratch);
+    la_set_field_args(la_kernel_step_fused, 3);
+    step_local = local_step_fused;
+    break;
+  default:
+    break;
+  }
+  if (step_local.dimensions() == 0) {
+    local_work_size = std::vector<cl_int>({0, 0});
+  } else {
+    local_work_size = std::vector<cl_int>({
+        static_cast<cl_int>(step_local.get()[0]),
+        static_cast<cl_int>(step_local.get()[1])});
+  }
+  local_draw = cl::NullRange;
+  if (!headless && step_local.dimensions() != 0
+      && la_local_fits(la_kernel_clear_image, step_local, false)
+      && la_local_fits(la_kernel_draw_image, step_local, false)) {
+    local_draw = step_local;
+  }
+}
+
+/*
+  Select the device, create the context, buffers and kernels.
+*/
+static void initCL(size_t device_index) {
+  device = la_list_devices({device_index})[device_index];
+  platform = cl::Platform(device.getInfo<CL_DEVICE_PLATFORM>());
+  if (headless) {
+    context = cl::Context(device);
+  } else {
+    const cl_platform_id platform_id =
+      device.getInfo<CL_DEVICE_PLATFORM>()();
+    cl_context_properties properties[7];
+    properties[0] = CL_GL_CONTEXT_KHR;
+    properties[1] =
+      reinterpret_cast<cl_context_properties>(glXGetCurrentContext());
+    properties[2] = CL_GLX_DISPLAY_KHR;
+    properties[3] =
+      reinterpret_cast<cl_context_properties>(glXGetCurrentDisplay());
+    properties[4] = CL_CONTEXT_PLATFORM;
+    properties[5] = reinterpret_cast<cl_context_properties>(platform_id);
+    properties[6] = 0;
+
+    clGetGLContextInfoKHR_fn myGetGLContextInfoKHR =
+      reinterpret_cast<clGetGLContextInfoKHR_fn>(
+          clGetExtensionFunctionAddressForPlatform(
+              platform_id, "clGetGLContextInfoKHR"));
+
+    size_t size;
+    myGetGLContextInfoKHR(properties, CL_DEVICES_FOR_GL_CONTEXT_KHR,
+                          sizeof(cl_device_id), &device, &size);
+
+    context = cl::Context(device, properties);
+  }
+  command_queue = cl::CommandQueue(
+      context, device, kernel_timing ? CL_QUEUE_PROFILING_ENABLE : 0);
+
+  /* create buffers */
+  if (!headless) {
+    render_queue = cl::CommandQueue(
+        context, device, kernel_timing ? CL_QUEUE_PROFILING_ENABLE : 0);
+    dev_image = cl::ImageGL(
+        context, CL_MEM_WRITE_ONLY, GL_TEXTURE_2D,
+        0, rendered_texture);
+    const std::array<size_t, 3> region = la_frame_region();
+    const cl::ImageFormat format(CL_R, CL_UNORM_INT8);
+    dev_frame = cl::Image2D(context, CL_MEM_READ_WRITE, format,
+                            region[0], region[1]);
+    dev_frame_front = cl::Image2D(context, CL_MEM_READ_WRITE, format,
+                                  region[0], region[1]);
+  }
+  if (engine == LA_ENGINE_PACKED) {
+    packed_stride = (field_width + 31) / 32;
+    dev_field_packed = cl::Buffer(
+        context, CL_MEM_READ_WRITE,
+        sizeof(cl_uint) * packed_stride * field_height);
+  } else {
+    dev_field_in = cl::Buffer(context, CL_MEM_READ_WRITE, la_field_bytes());
+  }
+  if (engine == LA_ENGINE_DENSE || engine == LA_ENGINE_FUSED) {
+    dev_field_out = cl::Buffer(context, CL_MEM_READ_WRITE, la_field_bytes());
+  }
+  if ((engine == LA_ENGINE_SPARSE || engine == LA_ENGINE_PACKED)
+      && !ants.empty()) {
+    dev_ants = cl::Buffer(
+        context, CL_MEM_READ_WRITE,
+        sizeof(la_ant) * ants.size());
+  }
+  /* end create buffers */
+
+  program = la_build_program(context);
+  if (!headless) {
+    la_kernel_clear_image = cl::Kernel(program, "la_clear_image");
+    la_kernel_clear_image.setArg(0, dev_frame);
+    la_kernel_clear_image.setArg(1, field_width);
+    la_kernel_clear_image.setArg(2, field_height);
+  }
+
+  switch (engine) {
+  case LA_ENGINE_DENSE:
+    la_kernel_rotate_and_flip = cl::Kernel(program, "la_rotate_and_flip");
+    la_kernel_rotate_and_flip.setArg(0, dev_field_in);
+    la_kernel_rotate_and_flip.setArg(1, dev_field_out);
+    la_set_field_args(la_kernel_rotate_and_flip, 2);
+
+    la_kernel_forward = cl::Kernel(program, "la_forward");
+    la_kernel_forward.setArg(0, dev_field_out);
+    la_kernel_forward.setArg(1, dev_field_in);
+    la_set_field_args(la_kernel_forward, 2);
+
+    if (!headless) {
+      la_kernel_draw_image = cl::Kernel(program, "la_draw_image");
+      la_kernel_draw_image.setArg(0, dev_field_in);
+      la_set_field_args(la_kernel_draw_image, 1);
+      la_kernel_draw_image.setArg(4, dev_frame);
+    }
+    break;
+  case LA_ENGINE_FUSED:
+    la_kernel_step_fused = cl::Kernel(program, "la_step_fused");
+    la_set_field_args(la_kernel_step_fused, 3);
+    if (!headless) {
+      la_kernel_draw_image = cl::Kernel(program, "la_draw_image");
+      la_set_field_args(la_kernel_draw_image, 1);
+      la_kernel_draw_image.setArg(4, dev_frame);
+    }
+    break;
+  case LA_ENGINE_SPARSE:
+    la_kernel_ants_rotate = cl::Kernel(program, "la_ants_rotate");
+    la_kernel_ants_forward = cl::Kernel(program, "la_ants_forward");
+    la_kernel_ants_draw_image = cl::Kernel(program, "la_ants_draw_image");
+    if (!ants.empty()) {
+      for (cl::Kernel* k : {&la_kernel_ants_rotate,
+                            &la_kernel_ants_forward}) {
+        k->setArg(0, dev_field_in);
+        k->setArg(1, dev_ants);
+        la_set_field_args(*k, 2);
+      }
+      if (!headless) {
+        la_kernel_ants_draw_image.setArg(0, dev_field_in);
+        la_kernel_ants_draw_image.setArg(1, dev_ants);
+        la_kernel_ants_draw_image.setArg(2, field_stride);
+        la_kernel_ants_draw_image.setArg(3, dev_frame);
+      }
+    }
+    break;
+  case LA_ENGINE_PACKED:
+    la_kernel_packed_ants_rotate =
+      cl::Kernel(program, "la_packed_ants_rotate");
+    la_kernel_packed_ants_forward =
+      cl::Kernel(program, "la_packed_ants_forward");
+    la_kernel_packed_ants_draw_image =
+      cl::Kernel(program, "la_packed_ants_draw_image");
+    if (!ants.empty()) {
+      la_kernel_packed_ants_rotate.setArg(0, dev_field_packed);
+      la_kernel_packed_ants_rotate.setArg(1, dev_ants);
+      la_kernel_packed_ants_rotate.setArg(2, packed_stride);
+      la_kernel_packed_ants_forward.setArg(0, dev_field_packed);
+      la_kernel_packed_ants_forward.setArg(1, dev_ants);
+      la_kernel_packed_ants_forward.setArg(2, packed_stride);
+      la_kernel_packed_ants_forward.setArg(3, field_width);
+      la_kernel_packed_ants_forward.setArg(4, field_height);
+      if (!headless) {
+        la_kernel_packed_ants_draw_image.setArg(0, dev_field_packed);
+        la_kernel_packed_ants_draw_image.setArg(1, dev_ants);
+        la_kernel_packed_ants_draw_image.setArg(2, packed_stride);
+        la_kernel_packed_ants_draw_image.setArg(3, dev_frame);
+      }
+    }
+    break;
+  case LA_ENGINE_CPU:
+  case LA_ENGINE_STRIPS:
+    break;
+  }
+  if (lod) {
+    if (engine == LA_ENGINE_PACKED) {
+      la_kernel_view = cl::Kernel(program, "la_view_packed");
+      la_kernel_view.setArg(1, packed_stride);
+    } else {
+      la_kernel_view = cl::Kernel(program, "la_view_field");
+      la_kernel_view.setArg(1, field_stride);
+    }
+    la_kernel_view.setArg(2, field_width);
+    la_kernel_view.setArg(3, field_height);
+    la_kernel_view.setArg(7, dev_frame);
+    if ((engine == LA_ENGINE_SPARSE || engine == LA_ENGINE_PACKED)
+        && !ants.empty()) {
+      la_kernel_view_ants = cl::Kernel(program, "la_view_ants");
+      la_kernel_view_ants.setArg(0, dev_ants);
+      la_kernel_view_ants.setArg(1, field_width);
+      la_kernel_view_ants.setArg(2, field_height);
+      la_kernel_view_ants.setArg(8, dev_frame);
+    }
+  }
+  if (stats_interval > 0) {
+    dev_stats = cl::Buffer(context, CL_MEM_READ_WRITE,
+                           sizeof(cl_uint) * STATS_SIZE);
+    if (engine == LA_ENGINE_PACKED) {
+      la_kernel_stats = cl::Kernel(program, "la_packed_stats");
+      la_kernel_stats.setArg(2, packed_stride);
+      la_kernel_stats.setArg(3, field_height);
+    } else {
+      la_kernel_stats = cl::Kernel(program, "la_field_stats");
+      la_set_field_args(la_kernel_stats, 2);
+    }
+    la_kernel_stats.setArg(1, dev_stats);
+  }
+  if (autotune) {
+    la_autotune();
+  }
+  if (engine == LA_ENGINE_FUSED) {
+    la_kernel_step_fused.setArg(2, la_tile_size(local_step_fused));
+  }
+}
+
+/*
+  Upload the initial field (and the ants of the sparse and packed engines).
+  The packed engine takes the colour words of a mapped snapshot as they
+  are when given, and starts from an all white field when field_init is
+  empty.
+*/
+static void upload_field(const std::vector<cl_char>& field_init,
+                         const cl_uint* snapshot_words = 0) {
+  if ((engine == LA_ENGINE_SPARSE || engine == LA_ENGINE_PACKED)
+      && !ants.empty()) {
+    command_queue.enqueueWriteBuffer(
+        dev_ants, CL_TRUE, 0,
+        sizeof(la_ant) * ants.size(),
+        &ants.front());
+  }
+  if (engine == LA_ENGINE_PACKED) {
+    const size_t n_words =
+      static_cast<size_t>(packed_stride) * field_height;
+    if (snapshot_words) {
+      command_queue.enqueueWriteBuffer(
+          dev_field_packed, CL_TRUE, 0,
+          sizeof(cl_uint) * n_words, snapshot_words);
+      return;
+    }
+    if (field_init.empty()) {
+      command_queue.enqueueFillBuffer(
+          dev_field_packed, static_cast<cl_uint>(0), 0,
+          sizeof(cl_uint) * n_words);
+      command_queue.finish();
+      return;
+    }
+    std::vector<cl_uint> words(n_words, 0);
+    for (cl_int y = 0; y < field_height; ++y) {
+      for (cl_int x = 0; x < field_width; ++x) {
+        if ((field_init[static_cast<size_t>(y) * field_width + x]
+             & BIT_BW) != 0) {
+          words[static_cast<size_t>(y) * packed_stride + (x >> 5)] |=
+            1u << (x & 31);
+        }
+      }
+    }
+    command_queue.enqueueWriteBuffer(
+        dev_field_packed, CL_TRUE, 0,
+        sizeof(cl_uint) * n_words, &words.front());
+    return;
+  }
+  if (field_tiles) {
+    std::vector<cl_char> tiled(field_init);
+    la_convert_layout(tiled, true);
+    command_queue.enqueueWriteBuffer(
+        dev_field_in, CL_TRUE, 0, sizeof(cl_char) * tiled.size(),
+        &tiled.front());
+    return;
+  }
+  command_queue.enqueueWriteBuffer(
+      dev_field_in, CL_TRUE, 0, la_field_bytes(), &field_init.front());
+}
+
+/*
+  Split the field into one horizontal strip per selected device (or per
+  CPU sub-device with -S), each in its own context and queue, and upload
+  the strips of field_init with their halo rows.
+*/
+static void initStrips(const std::vector<cl_char>& field_init) {
+  const std::vector<cl::Device> all = la_list_devices(strip_devices);
+  std::vector<cl::Device> devices;
+  for (const size_t index : strip_devices) {
+    cl::Device dev = all[index];
+    if (sub_devices > 1
+        && dev.getInfo<CL_DEVICE_TYPE>() == CL_DEVICE_TYPE_CPU) {
+      const cl_uint units = dev.getInfo<CL_DEVICE_MAX_COMPUTE_UNITS>();
+      const cl_device_partition_property properties[] = {
+        CL_DEVICE_PARTITION_EQUALLY,
+        static_cast<cl_device_partition_property>(
+            std::max<size_t>(1, units / sub_devices)),
+        0};
+      std::vector<cl::Device> subs;
+      dev.createSubDevices(properties, &subs);
+      subs.resize(std::min(subs.size(), sub_devices));
+      devices.insert(devices.end(), subs.begin(), subs.end());
+    } else {
+      devices.push_back(dev);
+    }
+  }
+  const cl_int width = field_width;
+  const cl_int height = field_height;
+  const cl_int n = static_cast<cl_int>(devices.size());
+  if (n > height) {
+    std::cerr << "more strips than rows" << std::endl;
+    exit(1);
+  }
+  strips.resize(n);
+  cl_int y0 = 0;
+  for (cl_int i = 0; i < n; ++i) {
+    la_strip& s = strips[i];
+    s.device = devices[i];
+    s.y0 = y0;
+    s.rows = height / n + ((i < height % n) ? 1 : 0);
+    y0 += s.rows;
+    const size_t bytes = sizeof(cl_char) * width * (s.rows + 2);
+    if (bytes > s.device.getInfo<CL_DEVICE_MAX_MEM_ALLOC_SIZE>()) {
+      std::cerr << "strip[" << i << "]: " << bytes
+                << " bytes exceed CL_DEVICE_MAX_MEM_ALLOC_SIZE,"
+                << " use more devices" << std::endl;
+      exit(1);
+    }
+    s.context = cl::Context(s.device);
+    s.queue = cl::CommandQueue(s.context, s.device,
+                               CL_QUEUE_PROFILING_ENABLE);
+    for (cl::Buffer& b : s.field) {
+      b = cl::Buffer(s.context, CL_MEM_READ_WRITE, bytes);
+    }
+    s.step = cl::Kernel(la_build_program(s.context), "la_strip_step");
+    s.step.setArg(2, width);
+    for (int p = 0; p < 2; ++p) {
+      s.first_row[p].resize(width);
+      s.last_row[p].resize(width);
+    }
+    s.kernel_ns = 0;
+
+    // rows y0 - 1 to y0 + rows, wrapping around
+    std::vector<cl_char> rows(static_cast<size_t>(width) * (s.rows + 2));
+    for (cl_int r = 0; r < s.rows + 2; ++r) {
+      const cl_int y = (s.y0 - 1 + r + height) % height;
+      std::copy(field_init.begin() + static_cast<size_t>(y) * width,
+                field_init.begin() + static_cast<size_t>(y + 1) * width,
+                rows.begin() + static_cast<size_t>(r) * width);
+    }
+    s.queue.enqueueWriteBuffer(s.field[0], CL_TRUE, 0, bytes, &rows.front());
+    std::cout << "strip[" << i << "]: rows[" << s.y0 << "-"
+              << (s.y0 + s.rows) << "],name["
+              << s.device.getInfo<CL_DEVICE_NAME>() << "]" << std::endl;
+  }
+}
+
+// ----------------------------------------------------------------------
+// headless mode
+// ----------------------------------------------------------------------
+
+/*
+  Compare the field with the native engine run from the same start.
+*/
+static bool la_verify_field(const std::vector<cl_char>& field) {
+  la_cpu_engine reference(field_width, field_height, field_start,
+                          la_cpu_engine::MODE_DENSE);
+  reference.set_rule(rule);
+  reference.step(step - step_start);
+  std::vector<cl_char> expected;
+  reference.read_field(expected);
+  size_t n_diff = 0;
+  for (size_t i = 0; i < field.size(); ++i) {
+    if (field[i] != expected[i]) {
+      ++n_diff;
+    }
+  }
+  if (n_diff == 0) {
+    std::cout << "verify[ok]" << std::endl;
+    return true;
+  }
+  std::cout << "verify[" << n_diff << " squares differ]" << std::endl;
+  return false;
+}
+
+// initial ants of run b of the ensemble, cycling through the -n list
+static int la_ensemble_ants(size_t b) {
+  return ensemble_ants.empty() ? n_ants
+    : ensemble_ants[b % ensemble_ants.size()];
+}
+
+/*
+  Create the context and kernels of the ensemble, and upload its fields
+  one after the other into dev_field_in: run b starts with its own ants,
+  placed with seed + b.
+*/
+static void initEnsemble(size_t device_index) {
+  device = la_list_devices({device_index})[device_index];
+  context = cl::Context(device);
+  command_queue = cl::CommandQueue(
+      context, device, kernel_timing ? CL_QUEUE_PROFILING_ENABLE : 0);
+  const cl_int width = field_width;
+  const cl_int height = field_height;
+  const size_t squares = static_cast<size_t>(width) * height;
+  const size_t bytes = sizeof(cl_char) * squares * ensemble_runs;
+  if (bytes > device.getInfo<CL_DEVICE_MAX_MEM_ALLOC_SIZE>()) {
+    std::cerr << "ensemble: " << bytes
+              << " bytes exceed CL_DEVICE_MAX_MEM_ALLOC_SIZE,"
+              << " use fewer or smaller runs" << std::endl;
+    exit(1);
+  }
+  dev_field_in = cl::Buffer(context, CL_MEM_READ_WRITE, bytes);
+  dev_field_out = cl::Buffer(context, CL_MEM_READ_WRITE, bytes);
+  dev_ensemble_stats = cl::Buffer(
+      context, CL_MEM_READ_WRITE, sizeof(cl_uint) * 2 * ensemble_runs);
+
+  std::vector<cl_char> fields(squares * ensemble_runs);
+  for (size_t b = 0; b < ensemble_runs; ++b) {
+    std::vector<la_ant> run_ants;
+    la_init_random_ants(run_ants, seed + b, la_ensemble_ants(b));
+    std::vector<cl_char> field(squares);
+    la_put_ants(field, run_ants);
+    std::copy(field.begin(), field.end(), fields.begin() + squares * b);
+  }
+  command_queue.enqueueWriteBuffer(dev_field_in, CL_TRUE, 0, bytes,
+                                   &fields.front());
+
+  program = la_build_program(context);
+  la_kernel_ensemble_step = cl::Kernel(program, "la_ensemble_step");
+  la_kernel_ensemble_step.setArg(2, width);
+  la_kernel_ensemble_step.setArg(3, height);
+  la_kernel_ensemble_stats = cl::Kernel(program, "la_ensemble_stats");
+  la_kernel_ensemble_stats.setArg(1, dev_ensemble_stats);
+  la_kernel_ensemble_stats.setArg(2, width);
+  la_kernel_ensemble_stats.setArg(3, height);
+  std::cout << "ensemble: runs[" << ensemble_runs << "],name["
+            << device.getInfo<CL_DEVICE_NAME>() << "]" << std::endl;
+}
+
+/*
+  Time every device of the strip engine spent stepping, against the
+  elapsed time, and the slowest one against the average.
+*/
+static void la_report_strips(double elapsed) {
+  double total = 0.0;
+  double slowest = 0.0;
+  for (size_t i = 0; i < strips.size(); ++i) {
+    const double seconds = strips[i].kernel_ns * 1e-9;
+    total += seconds;
+    slowest = std::max(slowest, seconds);
+    std::cout << "strip[" << i << "]: rows[" << strips[i].rows << "]"
+              << ",kernel[" << seconds << "]"
+              << ",busy[" << (100.0 * seconds / elapsed) << "%]"
+              << std::endl;
+  }
+  const double mean = total / strips.size();
+  std::cout << "strips: imbalance["
+            << ((mean > 0.0) ? slowest / mean : 1.0) << "]" << std::endl;
+}
+
+/*
+  Bytes each generation has to move at least, for the GB/s figure:
+  one read and one write of every square per kernel pass for the dense
+  engines, and of the ant record and its square per pass for the sparse
+  ones. 0 when there is no such simple figure.
+*/
+static double la_bytes_per_step(size_t n_live_ants) {
+  const double squares = static_cast<double>(field_width) * field_height;
+  const double ant_pass = 2.0 * sizeof(la_ant);
+  switch (engine) {
+  case LA_ENGINE_DENSE:
+    return 4.0 * squares;
+  case LA_ENGINE_FUSED:
+  case LA_ENGINE_STRIPS:
+    return 2.0 * squares;
+  case LA_ENGINE_SPARSE:
+    return n_live_ants * (2.0 * ant_pass + 2.0 * sizeof(cl_char));
+  case LA_ENGINE_PACKED:
+    return n_live_ants * (2.0 * ant_pass + 3.0 * sizeof(cl_uint));
+  case LA_ENGINE_CPU:
+    if (cpu_engine->memo() || cpu_engine->plane()) {
+      return 0.0;
+    }
+    return cpu_engine->sparse()
+      ? n_live_ants * (2.0 * ant_pass + 2.0 * sizeof(cl_char))
+      : 4.0 * squares;
+  }
+  return 0.0;
+}
+
+/*
+  Append the results of the run to report_file: one JSON object per line
+  if its name ends in .json, else one CSV row (with a header line when
+  the file is new).
+*/
+static void la_write_report(double elapsed, size_t n_live_ants) {
+  const size_t steps = step - step_start;
+  const double steps_per_s = steps / elapsed;
+  const double cell_updates_per_s = steps_per_s
+    * static_cast<double>(field_width) * field_height;
+  const double gb_per_s = steps_per_s * la_bytes_per_step(n_live_ants) * 1e-9;
+  double kernel_s = 0.0;
+  for (const auto& kv : kernel_times) {
+    kernel_s += kv.second.ns * 1e-9;
+  }
+  const char* layout = field_tiles ? "tiles" : "rows";
+  // the cpu engines and strips have no single OpenCL device
+  const std::string device_name =
+    (engine == LA_ENGINE_CPU || engine == LA_ENGINE_STRIPS)
+    ? "" : device.getInfo<CL_DEVICE_NAME>();
+  const std::string name(report_file);
+  const bool json = name.size() >= 5
+    && name.compare(name.size() - 5, 5, ".json") == 0;
+  const bool is_new = !std::ifstream(report_file).good();
+  std::ofstream ofs(report_file, std::ios::app);
+  if (json) {
+    ofs << "{\"engine\":\"" << engine_name << "\""
+        << ",\"layout\":\"" << layout << "\""
+        << ",\"device\":\"" << device_name << "\""
+        << ",\"width\":" << field_width
+        << ",\"height\":" << field_height
+        << ",\"ants\":" << n_live_ants
+        << ",\"local\":[" << local_work_size[0] << ","
+        << local_work_size[1] << "]"
+        << ",\"seed\":" << seed
+        << ",\"steps\":" << steps
+        << ",\"wall_s\":" << elapsed
+        << ",\"steps_per_s\":" << steps_per_s
+        << ",\"cell_updates_per_s\":" << cell_updates_per_s
+        << ",\"gb_per_s\":" << gb_per_s
+        << ",\"kernel_s\":" << kernel_s
+        << ",\"kernels\":{";
+    const char* sep = "";
+    for (const auto& kv : kernel_times) {
+      ofs << sep << "\"" << kv.first << "\":{\"count\":" << kv.second.count
+          << ",\"seconds\":" << (kv.second.ns * 1e-9) << "}";
+      sep = ",";
+    }
+    ofs << "}}" << std::endl;
+  } else {
+    if (is_new) {
+      ofs << "engine,layout,device,width,height,ants,local_w,local_h,seed,"
+          << "steps,wall_s,steps_per_s,cell_updates_per_s,gb_per_s,kernel_s"
+          << std::endl;
+    }
+    ofs << engine_name << "," << layout << "," << device_name << ","
+        << field_width << "," << field_height << "," << n_live_ants << ","
+        << local_work_size[0] << "," << local_work_size[1] << ","
+        << seed << "," << steps << "," << elapsed << ","
+        << steps_per_s << "," << cell_updates_per_s << ","
+        << gb_per_s << "," << kernel_s << std::endl;
+  }
+  if (!ofs) {
+    std::cerr << "failed to write " << report_file << std::endl;
+  }
+}
+
+/*
+  Run max_steps generations (or forever) without OpenGL, as fast as the
+  device allows, then print the statistics and write the final field.
+  Returns false if --verify found a difference.
+*/
+static bool runHeadless() {
+  const auto start = std::chrono::steady_clock::now();
+  wall_clock = start;
+  // steps enqueued between two synchronizations
+  const size_t batch = (steps_per_frame > 0) ? steps_per_frame : 256;
+  while (max_steps == 0 || step < max_steps) {
+    size_t k = (max_steps == 0) ? batch
+      : std::min(batch, max_steps - step);
+    if (checkpoint_interval > 0) {
+      k = std::min(k, checkpoint_interval - step % checkpoint_interval);
+    }
+    if (stats_interval > 0) {
+      k = std::min(k, stats_interval - step % stats_interval);
+    }
+    if (record_file) {
+      k = std::min(k, record_interval - step % record_interval);
+    }
+    la_enqueue_generations(k);
+    // the strip engine synchronizes on every step
+    if (engine != LA_ENGINE_CPU && engine != LA_ENGINE_STRIPS) {
+      command_queue.finish();
+      if (kernel_timing) {
+        la_collect_kernel_times();
+      }
+      la_poll_stats(false);
+    }
+    step += k;
+    step_count += k;
+    if (stats_interval > 0 && step % stats_interval == 0) {
+      la_enqueue_stats();
+    }
+    if (record_file && step % record_interval == 0) {
+      la_record_frame();
+    }
+    const auto now = std::chrono::steady_clock::now();
+    const double seconds =
+      std::chrono::duration<double>(now - wall_clock).count();
+    if (seconds > 1.0) {
+      std::stringstream ss;
+      ss << "step[" << step << "],steps/s[" << (step_count / seconds) << "]";
+      if (!stats_summary.empty()) {
+        ss << "," << stats_summary;
+      }
+      show_report(ss.str());
+      step_count = 0;
+      wall_clock = now;
+      la_profile_tick();
+    }
+    if (checkpoint_interval > 0 && step % checkpoint_interval == 0) {
+      la_save_snapshot(save_file);
+    }
+  }
+  const double elapsed = std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - start).count();
+  la_poll_stats(true);
+
+  std::vector<cl_char> field;
+  size_t n_black = 0;
+  size_t n_live_ants = 0;
+  if (engine == LA_ENGINE_PACKED && !output_file && !verify) {
+    // count on the packed words, without expanding the field
+    std::vector<cl_uint> words;
+    la_read_packed(words);
+    for (const cl_uint w : words) {
+      n_black += __builtin_popcount(w);
+    }
+    n_live_ants = ants.size();
+  } else {
+    la_read_field(field);
+    for (const cl_char c : field) {
+      if ((c & BITS_COLOUR) != 0) {
+        ++n_black;
+      }
+      for (cl_int d : {BIT_N, BIT_E, BIT_S, BIT_W}) {
+        if ((c & d) != 0) {
+          ++n_live_ants;
+        }
+      }
+    }
+  }
+  std::cout << "step[" << step << "]"
+            << ",black[" << n_black << "]"
+            << ",ants[" << n_live_ants << "]"
+            << ",elapsed[" << elapsed << "]"
+            << ",steps/s[" << ((step - step_start) / elapsed) << "]";
+  if (engine == LA_ENGINE_CPU && fast_forward) {
+    std::cout << ",fast_forwarded[" << cpu_engine->fast_forwarded() << "]";
+  }
+  if (engine == LA_ENGINE_CPU && cpu_engine->memo()) {
+    const la_memo_engine* memo = cpu_engine->memo();
+    const size_t lookups = memo->hits() + memo->misses();
+    std::cout << ",lookups[" << lookups << "]"
+              << ",hit_rate[" << ((lookups == 0) ? 0.0
+                                  : static_cast<double>(memo->hits())
+                                  / lookups) << "]";
+  }
+  if (engine == LA_ENGINE_CPU && cpu_engine->plane()) {
+    const la_plane_engine* plane = cpu_engine->plane();
+    int32_t x0, y0, x1, y1;
+    if (plane->bounding_box(x0, y0, x1, y1)) {
+      std::cout << ",bbox[" << x0 << "," << y0 << "," << x1 << "," << y1
+                << "]";
+    }
+    std::cout << ",chunks[" << plane->chunks() << "]";
+  }
+  std::cout << std::endl;
+  if (engine == LA_ENGINE_STRIPS) {
+    la_report_strips(elapsed);
+  }
+  if (report_file) {
+    la_write_report(elapsed, n_live_ants);
+  }
+  if (output_file) {
+    la_write_pgm(output_file, field);
+  }
+  return !verify || la_verify_field(field);
+}
+
+/*
+  Append one row per run of the ensemble to report_file, or print them
+  on stdout without --report: one JSON object per line if the name ends
+  in .json, else CSV with a header line when the file is new.
+*/
+static void la_write_ensemble_rows(const std::vector<cl_uint>& stats) {
+  const std::string name(report_file ? report_file : "");
+  const bool json = name.size() >= 5
+    && name.compare(name.size() - 5, 5, ".json") == 0;
+  const bool is_new = !report_file || !std::ifstream(report_file).good();
+  std::ofstream ofs;
+  if (report_file) {
+    ofs.open(report_file, std::ios::app);
+  }
+  std::ostream& os = report_file ? ofs : std::cout;
+  if (!json && is_new) {
+    os << "run,width,height,seed,ants_init,steps,black,ants" << std::endl;
+  }
+  for (size_t b = 0; b < ensemble_runs; ++b) {
+    if (json) {
+      os << "{\"run\":" << b
+         << ",\"width\":" << field_width
+         << ",\"height\":" << field_height
+         << ",\"seed\":" << (seed + b)
+         << ",\"ants_init\":" << la_ensemble_ants(b)
+         << ",\"steps\":" << step
+         << ",\"black\":" << stats[2 * b]
+         << ",\"ants\":" << stats[2 * b + 1] << "}" << std::endl;
+    } else {
+      os << b << "," << field_width << "," << field_height
+         << "," << (seed + b) << "," << la_ensemble_ants(b) << "," << step
+         << "," << stats[2 * b] << "," << stats[2 * b + 1] << std::endl;
+    }
+  }
+  if (!os) {
+    std::cerr << "failed to write " << name << std::endl;
+  }
+}
+
+/*
+  Run max_steps generations of every field of the ensemble in one launch
+  per generation, then count the black squares and ants of each run on
+  the device and write one row per run.
+*/
+static void runEnsemble() {
+  // rounded up as in la_enqueue_stats; la_ensemble_step skips the rest
+  const cl::NDRange range =
+    la_field_range(cl::NDRange(FIELD_ALIGN, FIELD_ALIGN));
+  const cl::NDRange global(range.get()[0], range.get()[1], ensemble_runs);
+  const auto start = std::chrono::steady_clock::now();
+  wall_clock = start;
+  const size_t batch = (steps_per_frame > 0) ? steps_per_frame : 256;
+  while (step < max_steps) {
+    const size_t k = std::min(batch, max_steps - step);
+    for (size_t i = 0; i < k; ++i) {
+      la_kernel_ensemble_step.setArg(0, dev_field_in);
+      la_kernel_ensemble_step.setArg(1, dev_field_out);
+      la_enqueue_kernel(la_kernel_ensemble_step, global, cl::NullRange);
+      std::swap(dev_field_in, dev_field_out);
+    }
+    command_queue.finish();
+    if (kernel_timing) {
+      la_collect_kernel_times();
+    }
+    step += k;
+    step_count += k;
+    const auto now = std::chrono::steady_clock::now();
+    const double seconds =
+      std::chrono::duration<double>(now - wall_clock).count();
+    if (seconds > 1.0) {
+      std::stringstream ss;
+      ss << "step[" << step << "],steps/s[" << (step_count / seconds) << "]";
+      show_report(ss.str());
+      step_count = 0;
+      wall_clock = now;
+      la_profile_tick();
+    }
+  }
+  const double elapsed = std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - start).count();
+
+  command_queue.enqueueFillBuffer(dev_ensemble_stats, cl_uint(0), 0,
+                                  sizeof(cl_uint) * 2 * ensemble_runs);
+  la_kernel_ensemble_stats.setArg(0, dev_field_in);
+  la_enqueue_kernel(la_kernel_ensemble_stats,
+                    cl::NDRange(field_height, ensemble_runs),
+                    cl::NullRange);
+  std::vector<cl_uint> stats(2 * ensemble_runs);
+  command_queue.enqueueReadBuffer(dev_ensemble_stats, CL_TRUE, 0,
+                                  sizeof(cl_uint) * stats.size(),
+                                  &stats.front());
+  if (kernel_timing) {
+    la_collect_kernel_times();
+  }
+  const double squares =
+    static_cast<double>(field_width) * field_height * ensemble_runs;
+  std::cout << "runs[" << ensemble_runs << "]"
+            << ",step[" << step << "]"
+            << ",elapsed[" << elapsed << "]"
+            << ",steps/s[" << (step / elapsed) << "]"
+            << ",cell_updates/s[" << (step * squares / elapsed) << "]"
+            << std::endl;
+  la_write_ensemble_rows(stats);
+}
+
+// long options without a short form
+enum {
+  OPT_SAVE = 256,
+  OPT_LOAD,
+  OPT_CHECKPOINT,
+  OPT_SEED,
+  OPT_REPORT,
+  OPT_PROFILE,
+  OPT_TRACE,
+  OPT_STATS,
+  OPT_STATS_LOG,
+  OPT_LOD,
+  OPT_RULE,
+  OPT_RECORD,
+  OPT_RECORD_INTERVAL,
+  OPT_LAYOUT,
+};
+
+int main(int argc, char *argv[]) {
+  try {
+    size_t device_index = 0;
+    int local_w = FIELD_ALIGN;
+    int local_h = FIELD_ALIGN;
+    bool steps_per_frame_given = false;
+    for (;;) {
+      int option_index = 0;
+      static struct option long_options[] = {
+        {"device", required_argument, 0, 'd'},
+        {"width", required_argument, 0, 'w'},
+        {"height", required_argument, 0, 'h'},
+        {"nants", required_argument, 0, 'n'},
+        {"interval", required_argument, 0, 'i'},
+        {"pause", no_argument, 0, 'P'},
+        {"engine", required_argument, 0, 'e'},
+        {"steps-per-frame", required_argument, 0, 'k'},
+        {"headless", no_argument, 0, 'H'},
+        {"steps", required_argument, 0, 's'},
+        {"output", required_argument, 0, 'o'},
+        {"verify", no_argument, 0, 'V'},
+        {"fast-forward", no_argument, 0, 'F'},
+        {"devices", required_argument, 0, 'D'},
+        {"sub-devices", required_argument, 0, 'S'},
+        {"ensemble", required_argument, 0, 'B'},
+        {"save", required_argument, 0, OPT_SAVE},
+        {"load", required_argument, 0, OPT_LOAD},
+        {"checkpoint", required_argument, 0, OPT_CHECKPOINT},
+        {"local", required_argument, 0, 'l'},
+        {"seed", required_argument, 0, OPT_SEED},
+        {"report", required_argument, 0, OPT_REPORT},
+        {"profile", no_argument, 0, OPT_PROFILE},
+        {"trace", required_argument, 0, OPT_TRACE},
+        {"stats", required_argument, 0, OPT_STATS},
+        {"stats-log", required_argument, 0, OPT_STATS_LOG},
+        {"lod", required_argument, 0, OPT_LOD},
+        {"rule", required_argument, 0, OPT_RULE},
+        {"record", required_argument, 0, OPT_RECORD},
+        {"record-interval", required_argument, 0, OPT_RECORD_INTERVAL},
+        {"layout", required_argument, 0, OPT_LAYOUT},
+        {0, 0, 0}};
+      int opt = getopt_long(argc, argv, "d:w:h:n:i:Pe:k:Hs:o:VFD:S:l:B:",
+                            long_options, &option_index);
+      if (opt == -1) {
+        break;
+      }
+      switch (opt) {
+      case 'd':
+        device_index = atoi(optarg);
+        break;
+      case 'w':
+        {
+          const int w = atoi(optarg);
+          field_width = w;
+          window_width = w;
+        }
+        break;
+      case 'h':
+        {
+          const int h = atoi(optarg);
+          field_height = h;
+          window_height = h;
+        }
+        break;
+      case 'n':
+        {
+          std::stringstream ss(optarg);
+          std::string item;
+          ensemble_ants.clear();
+          while (std::getline(ss, item, ',')) {
+            ensemble_ants.push_back(atoi(item.c_str()));
+          }
+          n_ants = ensemble_ants.empty() ? 0 : ensemble_ants[0];
+        }
+        break;
+      case 'i':
+        gen_mills = atoi(optarg);
+        break;
+      case 'P':
+        paused = 2;
+        break;
+      case 'e':
+        engine_name = optarg;
+        if (strcmp(optarg, "dense") == 0) {
+          engine = LA_ENGINE_DENSE;
+        } else if (strcmp(optarg, "fused") == 0) {
+          engine = LA_ENGINE_FUSED;
+        } else if (strcmp(optarg, "sparse") == 0) {
+          engine = LA_ENGINE_SPARSE;
+        } else if (strcmp(optarg, "packed") == 0) {
+          engine = LA_ENGINE_PACKED;
+        } else if (strcmp(optarg, "cpu") == 0) {
+          engine = LA_ENGINE_CPU;
+          cpu_mode = la_cpu_engine::MODE_AUTO;
+        } else if (strcmp(optarg, "cpu-dense") == 0) {
+          engine = LA_ENGINE_CPU;
+          cpu_mode = la_cpu_engine::MODE_DENSE;
+        } else if (strcmp(optarg, "cpu-sparse") == 0) {
+          engine = LA_ENGINE_CPU;
+          cpu_mode = la_cpu_engine::MODE_SPARSE;
+        } else if (strcmp(optarg, "cpu-memo") == 0) {
+          engine = LA_ENGINE_CPU;
+          cpu_mode = la_cpu_engine::MODE_MEMO;
+        } else if (strcmp(optarg, "cpu-plane") == 0) {
+          engine = LA_ENGINE_CPU;
+          cpu_mode = la_cpu_engine::MODE_PLANE;
+        } else if (strcmp(optarg, "strips") == 0) {
+          engine = LA_ENGINE_STRIPS;
+        } else {
+          std::cerr << "unknown engine: " << optarg << std::endl;
+          exit(1);
+        }
+        break;
+      case 'k':
+        if (strcmp(optarg, "auto") == 0) {
+          steps_per_frame = 0;
+        } else {
+          steps_per_frame = std::max(1, atoi(optarg));
+        }
+        steps_per_frame_given = true;
+        break;
+      case 'H':
+        headless = true;
+        break;
+      case 's':
+        max_steps = strtoull(optarg, 0, 10);
+        break;
+      case 'o':
+        output_file = optarg;
+        break;
+      case 'V':
+        verify = true;
+        break;
+      case 'F':
+        fast_forward = true;
+        break;
+      case 'D':
+        {
+          std::stringstream ss(optarg);
+          std::string item;
+          while (std::getline(ss, item, ',')) {
+            strip_devices.push_back(atoi(item.c_str()));
+          }
+        }
+        break;
+      case 'S':
+        sub_devices = atoi(optarg);
+        break;
+      case 'B':
+        ensemble_runs = strtoul(optarg, 0, 10);
+        break;
+      case OPT_SAVE:
+        save_file = optarg;
+        break;
+      case OPT_LOAD:
+        load_file = optarg;
+        break;
+      case OPT_CHECKPOINT:
+        checkpoint_interval = strtoull(optarg, 0, 10);
+        break;
+      case 'l':
+        if (strcmp(optarg, "auto") == 0) {
+          autotune = true;
+          local_w = local_h = FIELD_ALIGN;
+        } else if (sscanf(optarg, "%dx%d", &local_w, &local_h) != 2
+                   || local_w <= 0 || local_h <= 0) {
+          std::cerr << "bad work-group size: " << optarg << std::endl;
+          exit(1);
+        } else {
+          autotune = false;
+        }
+        break;
+      case OPT_SEED:
+        seed = strtoul(optarg, 0, 10);
+        seed_given = true;
+        break;
+      case OPT_REPORT:
+        report_file = optarg;
+        kernel_timing = true;
+        break;
+      case OPT_PROFILE:
+        profile = true;
+        kernel_timing = true;
+        break;
+      case OPT_TRACE:
+        trace_file = optarg;
+        kernel_timing = true;
+        break;
+      case OPT_STATS:
+        stats_interval = strtoull(optarg, 0, 10);
+        break;
+      case OPT_STATS_LOG:
+        stats_log_file = optarg;
+        break;
+      case OPT_RECORD:
+        {
+          record_file = optarg;
+          const std::string name(optarg);
+          const auto ends_with = [&name](const std::string& suffix) {
+            return name.size() >= suffix.size()
+              && name.compare(name.size() - suffix.size(), suffix.size(),
+                              suffix) == 0;
+          };
+          record_format = ends_with(".csv") ? RECORD_ANTS
+            : ends_with(".pgm") ? RECORD_PGM
+            : ends_with(".delta") ? RECORD_DELTA : RECORD_RAW;
+        }
+        break;
+      case OPT_RECORD_INTERVAL:
+        record_interval = strtoull(optarg, 0, 10);
+        break;
+      case OPT_RULE:
+        if (!la_parse_rule(optarg, rule)) {
+          std::cerr << "--rule takes 2 to " << LA_RULE_MAX_COLOURS
+                    << " of the letters R, L, N and U" << std::endl;
+          exit(1);
+        }
+        rule_string = optarg;
+        break;
+      case OPT_LAYOUT:
+        if (strcmp(optarg, "rows") == 0) {
+          field_tiles = false;
+        } else if (strcmp(optarg, "tiles") == 0) {
+          field_tiles = true;
+        } else {
+          std::cerr << "--layout takes rows or tiles" << std::endl;
+          exit(1);
+        }
+        break;
+      case OPT_LOD:
+        if (strcmp(optarg, "on") == 0) {
+          lod_mode = 1;
+        } else if (strcmp(optarg, "off") == 0) {
+          lod_mode = 0;
+        } else if (strcmp(optarg, "auto") == 0) {
+          lod_mode = -1;
+        } else {
+          std::cerr << "--lod takes on, off or auto" << std::endl;
+          exit(1);
+        }
+        break;
+      default:
+        std::cerr << "Usage: " << argv[0] <<
+          " [-d N]"
+          " [-w width]"
+          " [-h height]"
+          " [-i interval_millis]"
+          " [-P]"
+          " [-e dense|fused|sparse|packed|strips"
+          "|cpu|cpu-dense|cpu-sparse|cpu-memo|cpu-plane]"
+          " [-D N,N... [-S N]]"
+          " [-B runs [-n N,N...]]"
+          " [-l WxH|auto]"
+          " [--load file] [--save file [--checkpoint steps]]"
+          " [--seed N] [--report file.json|file.csv]"
+          " [--profile] [--trace file.json]"
+          " [--stats steps [--stats-log file.csv]]"
+          " [--lod on|off|auto]"
+          " [--rule RL|RLR|LLRR...]"
+          " [--layout rows|tiles]"
+          " [--record file.raw|file.delta|file.pgm|file.csv"
+          " [--record-interval steps]]"
+          " [-k steps|auto]"
+          " [-F]"
+          " [-H [-s steps] [-o file.pgm] [-V]]" << std::endl;
+        std::cerr << " -d, --device    : Select compute device." << std::endl;
+        std::cerr << " -w, --width     : Field width." << std::endl;
+        std::cerr << " -h, --height    : Field height." << std::endl;
+        std::cerr << " -n, --nants     : Number of ants." << std::endl;
+        std::cerr << " -i, --interval  : Step interval in milli seconds." << std::endl;
+        std::cerr << " -P, --pause     : Pause at start. Will be released by 'p' key." << std::endl;
+        std::cerr << " -e, --engine    : Simulation engine." << std::endl;
+        std::cerr << " -D, --devices   : Devices of the strips engine, one strip each." << std::endl;
+        std::cerr << " -S, --sub-devices : Split each CPU device into N sub-devices (strips engine)." << std::endl;
+        std::cerr << " -B, --ensemble  : Run N independent fields at once (headless, dense rules)." << std::endl;
+        std::cerr << " -l, --local     : Work-group size of the field kernels, tuned per device by default." << std::endl;
+        std::cerr << "     --seed      : Seed of the random ants." << std::endl;
+        std::cerr << "     --report    : Append the results and kernel times to a JSON or CSV file." << std::endl;
+        std::cerr << "     --profile   : Print latency histograms of every OpenCL command." << std::endl;
+        std::cerr << "     --trace     : Write every OpenCL command to a Chrome trace file." << std::endl;
+        std::cerr << "     --stats     : Reduce the field statistics on the device every given number of steps." << std::endl;
+        std::cerr << "     --stats-log : Append the statistics to a CSV file." << std::endl;
+        std::cerr << "     --record    : Stream the field every --record-interval steps (1 by default) to a file, by its name: raw frames, .delta runs of changed squares, .pgm one image per frame, or .csv ant positions." << std::endl;
+        std::cerr << "     --rule      : Turn of the ants on every colour, R, L, N or U; RL is Langton's ant." << std::endl;
+        std::cerr << "     --layout    : Store the field on the device row by row, or as 8x8 tiles (dense, fused and sparse)." << std::endl;
+        std::cerr << "     --lod       : Draw the window from the field at screen resolution, on by default above " << VIEW_MAX_WINDOW << " squares." << std::endl;
+        std::cerr << "     --load      : Start from a snapshot instead of random ants." << std::endl;
+        std::cerr << "     --save      : Write a snapshot at the end of the run." << std::endl;
+        std::cerr << "     --checkpoint : Also write the snapshot every given number of steps." << std::endl;
+        std::cerr << " -k, --steps-per-frame : Steps per drawn frame, or 'auto' to fit the refresh interval." << std::endl;
+        std::cerr << " -F, --fast-forward : Skip ahead on highways (native sparse engine)." << std::endl;
+        std::cerr << " -H, --headless  : Run without OpenGL." << std::endl;
+        std::cerr << " -s, --steps     : Stop after the given number of steps." << std::endl;
+        std::cerr << " -o, --output    : Write the final field as PGM image." << std::endl;
+        std::cerr << " -V, --verify    : Check the final field against the native engine." << std::endl;
+        exit(1);
+      }
+    }
+    if (verify && engine == LA_ENGINE_CPU
+        && cpu_mode == la_cpu_engine::MODE_PLANE) {
+      std::cerr << "--verify compares with the torus, not with cpu-plane"
+                << std::endl;
+      exit(1);
+    }
+    if (engine == LA_ENGINE_STRIPS) {
+      if (!headless) {
+        std::cerr << "the strips engine runs headless only (-H)" << std::endl;
+        exit(1);
+      }
+      if (strip_devices.empty()) {
+        strip_devices.push_back(device_index);
+      }
+    }
+    if (ensemble_runs > 0) {
+      if (!headless || engine != LA_ENGINE_DENSE || max_steps == 0
+          || save_file || load_file || output_file || verify) {
+        std::cerr << "the ensemble (-B) runs the dense rules headless (-H)"
+                  << " for -s steps, without snapshots, -o or -V"
+                  << std::endl;
+        exit(1);
+      }
+    } else if (ensemble_ants.size() > 1) {
+      std::cerr << "several ant counts (-n N,N...) need the ensemble (-B)"
+                << std::endl;
+      exit(1);
+    }
+    if (stats_interval > 0) {
+      if (engine == LA_ENGINE_CPU || engine == LA_ENGINE_STRIPS
+          || ensemble_runs > 0) {
+        std::cerr << "--stats needs the dense, fused, sparse or packed"
+                  << " engine" << std::endl;
+        exit(1);
+      }
+    } else if (stats_log_file) {
+      std::cerr << "--stats-log needs --stats" << std::endl;
+      exit(1);
+    }
+    if (stats_log_file) {
+      stats_log.open(stats_log_file);
+      if (!stats_log) {
+        std::cerr << "failed to open " << stats_log_file << std::endl;
+        exit(1);
+      }
+      stats_log << "step,black,ants,collisions,x0,y0,x1,y1" << std::endl;
+    }
+    if (record_file) {
+      if (engine == LA_ENGINE_STRIPS || ensemble_runs > 0
+          || record_interval == 0) {
+        std::cerr << "--record needs one field on one device, and"
+                  << " --record-interval at least 1" << std::endl;
+        exit(1);
+      }
+    }
+    if (field_tiles
+        && ((engine != LA_ENGINE_DENSE && engine != LA_ENGINE_FUSED
+             && engine != LA_ENGINE_SPARSE) || ensemble_runs > 0)) {
+      std::cerr << "--layout tiles needs the dense, fused or sparse engine"
+                << std::endl;
+      exit(1);
+    }
+    if (!la_rule_is_rl(rule)) {
+      // one bit per square
+      if (engine == LA_ENGINE_PACKED
+          || (engine == LA_ENGINE_CPU
+              && (cpu_mode == la_cpu_engine::MODE_MEMO
+                  || cpu_mode == la_cpu_engine::MODE_PLANE))) {
+        std::cerr << "--rule other than RL needs the dense, fused, sparse,"
+                  << " strips, cpu-dense or cpu-sparse engine" << std::endl;
+        exit(1);
+      }
+      if (save_file || load_file) {
+        std::cerr << "snapshots hold two colours, not --rule "
+                  << rule_string << std::endl;
+        exit(1);
+      }
+      std::cout << "rule[" << rule_string << "]" << std::endl;
+    }
+    if (fast_forward && engine != LA_ENGINE_CPU) {
+      std::cerr << "--fast-forward needs a cpu engine" << std::endl;
+      exit(1);
+    }
+    if ((profile || trace_file) && engine == LA_ENGINE_CPU) {
+      std::cerr << "--profile and --trace time OpenCL commands,"
+                << " not the cpu engines" << std::endl;
+      exit(1);
+    }
+    if (trace_file) {
+      trace.open(trace_file);
+      if (!trace) {
+        std::cerr << "failed to open " << trace_file << std::endl;
+        exit(1);
+      }
+    }
+    profile_clock = std::chrono::steady_clock::now();
+    if (checkpoint_interval > 0 && !save_file) {
+      std::cerr << "--checkpoint needs --save" << std::endl;
+      exit(1);
+    }
+    if ((save_file || load_file) && engine == LA_ENGINE_CPU
+        && cpu_mode == la_cpu_engine::MODE_PLANE) {
+      std::cerr << "snapshots hold a torus, not cpu-plane" << std::endl;
+      exit(1);
+    }
+    la_snapshot snapshot = {};
+    if (load_file) {
+      la_map_snapshot(load_file, snapshot);
+      field_width = window_width = snapshot.header->width;
+      field_height = window_height = snapshot.header->height;
+      step = step_start = snapshot.header->step;
+      seed = snapshot.header->seed;
+      std::cout << "loaded step[" << step << "] from " << load_file
+                << std::endl;
+    } else if (!seed_given) {
+      seed = time(0);
+    }
+    std::cout << "seed[" << seed << "]" << std::endl;
+    if (!headless) {
+      const bool large = field_width > VIEW_MAX_WINDOW
+        || field_height > VIEW_MAX_WINDOW;
+      if (engine == LA_ENGINE_CPU) {
+        if (lod_mode == 1) {
+          std::cerr << "--lod needs the dense, fused, sparse or packed"
+                    << " engine" << std::endl;
+          exit(1);
+        }
+      } else {
+        lod = (lod_mode == 1) || (lod_mode == -1 && large);
+      }
+      if (lod && large) {
+        // keep the aspect ratio of the field in a window that fits
+        const double scale = static_cast<double>(VIEW_MAX_WINDOW)
+          / std::max(field_width, field_height);
+        window_width = std::max(1, static_cast<int>(field_width * scale));
+        window_height = std::max(1, static_cast<int>(field_height * scale));
+      }
+    }
+    if (headless) {
+      if (!steps_per_frame_given) {
+        steps_per_frame = 0;
+      }
+    } else {
+      initGL(argc, argv);
+    }
+    // only dense and fused launch their field kernels with a work-group
+    // size; the other engines report 0 as if the driver picked it
+    if (ensemble_runs == 0
+        && (engine == LA_ENGINE_DENSE || engine == LA_ENGINE_FUSED)) {
+      local_work_size = std::vector<cl_int>({local_w, local_h});
+    } else {
+      local_work_size = std::vector<cl_int>({0, 0});
+    }
+    if (!autotune) {
+      local_rotate_and_flip = local_forward = local_step_fused = local_draw =
+        cl::NDRange(local_w, local_h);
+    }
+    field_stride = field_width;
+    field_rows = field_height;
+    if (field_tiles) {
+      const cl_int tile = 1 << FIELD_TILE_SHIFT;
+      field_stride = (field_width + tile - 1) / tile * tile;
+      field_rows = (field_height + tile - 1) / tile * tile;
+    }
+    std::cout << "field[" << field_width << "x" << field_height << "]"
+              << ",local[" << local_work_size[0] << "x"
+              << local_work_size[1] << "]" << std::endl;
+    if (ensemble_runs > 0) {
+      initEnsemble(device_index);
+      runEnsemble();
+      la_end_profile();
+      return 0;
+    }
+
+    /* init field_init */
+    std::vector<la_ant> ants_init;
+    if (load_file) {
+      ants_init.assign(snapshot.ants,
+                       snapshot.ants + snapshot.header->n_ants);
+    } else {
+      la_init_random_ants(ants_init, seed, n_ants);
+    }
+    std::vector<cl_char> field_init;
+    // the packed engine never needs the field in the dense layout
+    if (engine != LA_ENGINE_PACKED) {
+      if (load_file) {
+        la_unpack_field(snapshot.words, snapshot.header->stride, field_init);
+      } else {
+        field_init.resize(static_cast<size_t>(field_width) * field_height);
+      }
+    }
+    if (engine == LA_ENGINE_SPARSE || engine == LA_ENGINE_PACKED) {
+      ants = ants_init;
+    } else {
+      la_put_ants(field_init, ants_init);
+    }
+    if (verify) {
+      if (load_file) {
+        la_unpack_field(snapshot.words, snapshot.header->stride, field_start);
+      } else {
+        field_start.resize(static_cast<size_t>(field_width) * field_height);
+      }
+      la_put_ants(field_start, ants_init);
+    }
+    /* end init field_init */
+
+    if (engine == LA_ENGINE_CPU) {
+      cpu_engine.reset(new la_cpu_engine(
+          field_width, field_height, field_init, cpu_mode));
+      cpu_engine->set_rule(rule);
+      std::cout << "cpu engine: "
+                << (cpu_engine->memo() ? "memo"
+                    : cpu_engine->plane() ? "plane"
+                    : cpu_engine->sparse() ? "sparse" : "dense")
+                << ", threads=" << omp_get_max_threads() << std::endl;
+      if (fast_forward) {
+        cpu_engine->set_fast_forward(true);
+        if (!cpu_engine->fast_forwarding()) {
+          std::cerr << "fast forward disabled: needs the sparse mode,"
+                    << " few ants and the RL rule" << std::endl;
+        }
+      }
+    } else if (engine == LA_ENGINE_STRIPS) {
+      initStrips(field_init);
+    } else {
+      initCL(device_index);
+      upload_field(field_init, load_file ? snapshot.words : 0);
+    }
+    if (load_file) {
+      la_unmap_snapshot(snapshot);
+    }
+    if (record_file) {
+      initRecord();
+    }
+
+    if (headless) {
+      const bool ok = runHeadless();
+      if (record_file) {
+        endRecord();
+      }
+      la_end_profile();
+      if (save_file) {
+        la_save_snapshot(save_file);
+      }
+      if (!ok) {
+        return 1;
+      }
+    } else {
+      startGL();
+      if (record_file) {
+        endRecord();
+      }
+      la_poll_stats(true);
+      la_end_profile();
+      if (save_file) {
+        la_save_snapshot(save_file);
+      }
+    }
   } catch (const cl::Error& err) {
     report_cl_error(err);
   }
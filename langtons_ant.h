@@ -0,0 +1,80 @@
+#ifndef LANGTONS_ANT_H_
+#define LANGTONS_ANT_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// ----------------------------------------------------------------------
+// liblangtons_ant: the native engines (la_cpu_engine) behind a C API,
+// for programs and ctypes wrappers (langtons_ant_lib.py) that drive the
+// simulation themselves.
+// ----------------------------------------------------------------------
+
+typedef struct la_sim la_sim;
+
+// same layout as la_ant in langtons_ant_cpu.hpp and langtons_ant_kernel.cl
+typedef struct la_sim_ant {
+  int32_t x;
+  int32_t y;
+  int32_t d;  // 1 (north), 2 (east), 4 (south) or 8 (west)
+  int32_t c;  // colour of the square, in bits 4 to 6
+} la_sim_ant;
+
+/*
+  New simulation of width x height squares on a torus (with cpu-plane,
+  a window onto the unbounded plane, see below), from field in the
+  dense layout (one byte per square: direction bits 0 to 3, one ant per
+  bit, and the colour in bits 4 to 6), copied; 0 for an all white field
+  without ants. engine is one of the native engines of -e, "cpu" (0),
+  "cpu-dense", "cpu-sparse", "cpu-memo" or "cpu-plane", and rule a
+  --rule string, "RL" (0) being Langton's ant. Every engine takes any
+  positive width and height. cpu-plane does not wrap around: the ants
+  go on past the edges of the window, so its results differ from the
+  other engines once an ant reaches one. 0 on error, see la_sim_error.
+*/
+la_sim* la_sim_create(int width, int height, const int8_t* field,
+                      const char* engine, const char* rule);
+
+void la_sim_destroy(la_sim* sim);
+
+// Run n generations; 0 on success, -1 on error.
+int la_sim_step(la_sim* sim, uint64_t n);
+
+// Generations run since la_sim_create.
+uint64_t la_sim_steps(const la_sim* sim);
+
+// Enable highway detection and fast forward (cpu-sparse, RL only).
+void la_sim_set_fast_forward(la_sim* sim, int enable);
+
+/*
+  The current field, width * height squares in the dense layout. With
+  cpu-dense and cpu-sparse this is the engine's own field, not a copy:
+  cpu-sparse keeps only the colours in it, and the ants come from
+  la_sim_get_ants. cpu-memo and cpu-plane have no such field, so it is
+  expanded into a buffer of the simulation, ants included. Valid until
+  the next la_sim_step or la_sim_destroy. With cpu-plane, it holds the
+  squares inside the window only.
+*/
+const int8_t* la_sim_map_field(la_sim* sim);
+
+/*
+  Copy up to max ants into ants and return how many there are (call with
+  max 0 to size the array). cpu-dense gives one record per occupied
+  square instead, with the direction bits of all its ants in d.
+  cpu-plane gives the ants inside the window only, leaving out those
+  that have walked off it.
+*/
+size_t la_sim_get_ants(la_sim* sim, la_sim_ant* ants, size_t max);
+
+// Message of the last error of the calling thread.
+const char* la_sim_error(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // LANGTONS_ANT_H_
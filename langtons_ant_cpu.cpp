@@ -0,0 +1,611 @@
+#include <omp.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <unordered_map>
+#include "langtons_ant_cpu.hpp"
+#include "langtons_ant_memo.hpp"
+#include "langtons_ant_plane.hpp"
+
+// Fields with fewer ants than one per this many squares run in sparse mode.
+static const size_t SPARSE_SQUARES_PER_ANT = 64;
+
+// Below this number of ants the sparse step stays on one thread.
+static const size_t PARALLEL_MIN_ANTS = 4096;
+
+// Fast forward: longest period looked for, history kept per ant
+// (three periods are compared), generations between two attempts (doubled
+// after every failed attempt up to the maximum), and largest number of
+// ants it is tried with.
+static const size_t FF_MAX_PERIOD = 1024;
+static const size_t FF_HISTORY_SIZE = 3 * FF_MAX_PERIOD;
+static const size_t FF_CHECK_INTERVAL = 512;
+static const size_t FF_MAX_CHECK_INTERVAL = 65536;
+static const size_t FF_MAX_ANTS = 64;
+
+static inline int32_t turn(int32_t d, int8_t c_bw) {
+  if (!c_bw) {
+    // At a white square, turn 90° clockwise
+    return (d == BIT_W) ? BIT_N : (d << 1);
+  }
+  // At a black square, turn 90° counterclockwise
+  return (d == BIT_N) ? BIT_W : (d >> 1);
+}
+
+/*
+  Square c of the dense layout after its ants have turned by rule and
+  its colour has advanced, as turn and the flip do for RL.
+*/
+static inline int8_t rotate_square(int8_t c, const la_rule& rule) {
+  const int8_t c_ants = c & BITS_NEWS;
+  const int colour = (c & BITS_COLOUR) >> COLOUR_SHIFT;
+  if (c_ants == 0) {
+    return c & BITS_COLOUR;
+  }
+  const int t = la_rule_turn(rule, colour);
+  const int8_t c_news = ((c_ants << t) | (c_ants >> (4 - t))) & BITS_NEWS;
+  const int next = (colour + 1 == rule.colours) ? 0 : colour + 1;
+  return c_news | (next << COLOUR_SHIFT);
+}
+
+static inline void move(int32_t d, int64_t& x, int64_t& y) {
+  if (d == BIT_N) {
+    --y;
+  } else if (d == BIT_E) {
+    ++x;
+  } else if (d == BIT_S) {
+    ++y;
+  } else {
+    --x;
+  }
+}
+
+bool la_parse_rule(const char* s, la_rule& rule) {
+  rule = la_rule{0, 0};
+  for (; *s != '\0'; ++s) {
+    if (rule.colours == LA_RULE_MAX_COLOURS) {
+      return false;
+    }
+    uint32_t t;
+    switch (*s) {
+    case 'N': t = 0; break;
+    case 'R': t = 1; break;
+    case 'U': t = 2; break;
+    case 'L': t = 3; break;
+    default: return false;
+    }
+    rule.turns |= t << (2 * rule.colours);
+    ++rule.colours;
+  }
+  return rule.colours >= 2;
+}
+
+void la_extract_ants(std::vector<int8_t>& field, int width, int height,
+                     std::vector<la_ant>& ants) {
+  ants.clear();
+  for (int32_t y = 0; y < height; ++y) {
+    for (int32_t x = 0; x < width; ++x) {
+      int8_t& c = field[static_cast<size_t>(y) * width + x];
+      for (int32_t d : {BIT_N, BIT_E, BIT_S, BIT_W}) {
+        if ((c & d) != 0) {
+          ants.push_back(la_ant{x, y, d, 0});
+        }
+      }
+      c &= BITS_COLOUR;
+    }
+  }
+}
+
+la_cpu_engine::la_cpu_engine(int width, int height,
+                             const std::vector<int8_t>& field_init,
+                             mode_t mode)
+  : width_(width), height_(height), sparse_(false), rule_(la_rule_rl()),
+    field_(field_init),
+    fast_forward_(false), fast_forwarded_(0),
+    check_interval_(FF_CHECK_INTERVAL), steps_since_check_(0),
+    history_len_(0), history_pos_(0) {
+  if (mode == MODE_AUTO) {
+    size_t n_ants = 0;
+    for (const int8_t c : field_) {
+      n_ants += __builtin_popcount(c & BITS_NEWS);
+    }
+    mode = (n_ants * SPARSE_SQUARES_PER_ANT < field_.size())
+      ? MODE_SPARSE : MODE_DENSE;
+  }
+  sparse_ = (mode == MODE_SPARSE);
+  if (mode == MODE_MEMO || mode == MODE_PLANE) {
+    la_extract_ants(field_, width_, height_, ants_);
+    if (mode == MODE_MEMO) {
+      memo_.reset(new la_memo_engine(width_, height_, field_, ants_));
+    } else {
+      plane_.reset(new la_plane_engine(width_, height_, field_, ants_));
+    }
+    std::vector<int8_t>().swap(field_);
+    ants_.clear();
+  } else if (sparse_) {
+    la_extract_ants(field_, width_, height_, ants_);
+  } else {
+    work_.resize(field_.size());
+  }
+}
+
+la_cpu_engine::~la_cpu_engine() {
+}
+
+void la_cpu_engine::step(size_t n) {
+  if (memo_) {
+    memo_->step(n);
+    return;
+  }
+  if (plane_) {
+    plane_->step(n);
+    return;
+  }
+  if (fast_forward_) {
+    while (n > 0) {
+      if (steps_since_check_ >= check_interval_) {
+        steps_since_check_ = 0;
+        const size_t jumped = try_fast_forward(n);
+        check_interval_ = (jumped == 0)
+          ? std::min(2 * check_interval_, FF_MAX_CHECK_INTERVAL)
+          : FF_CHECK_INTERVAL;
+        fast_forwarded_ += jumped;
+        n -= jumped;
+        if (n == 0) {
+          break;
+        }
+      }
+      // only the generations right before the next attempt are needed
+      if (check_interval_ - steps_since_check_ <= FF_HISTORY_SIZE) {
+        record_history();
+      } else {
+        history_len_ = 0;
+      }
+      step_sparse<true>();
+      ++steps_since_check_;
+      --n;
+    }
+    return;
+  }
+  const bool rl = la_rule_is_rl(rule_);
+  for (size_t i = 0; i < n; ++i) {
+    if (!sparse_) {
+      step_dense();
+    } else if (rl) {
+      step_sparse<true>();
+    } else {
+      step_sparse<false>();
+    }
+  }
+}
+
+void la_cpu_engine::set_rule(const la_rule& rule) {
+  rule_ = rule;
+  if (!la_rule_is_rl(rule_)) {
+    set_fast_forward(false);
+  }
+}
+
+void la_cpu_engine::set_fast_forward(bool enable) {
+  fast_forward_ = enable && sparse_ && la_rule_is_rl(rule_) && !ants_.empty()
+    && ants_.size() <= FF_MAX_ANTS;
+  history_.resize(fast_forward_ ? FF_HISTORY_SIZE * ants_.size() : 0);
+  history_len_ = 0;
+  history_pos_ = 0;
+  check_interval_ = FF_CHECK_INTERVAL;
+  steps_since_check_ = 0;
+}
+
+void la_cpu_engine::record_history() {
+  for (size_t i = 0; i < ants_.size(); ++i) {
+    const la_ant& a = ants_[i];
+    history_[i * FF_HISTORY_SIZE + history_pos_] = history_entry{
+      a.x, a.y, static_cast<int8_t>(a.d),
+      static_cast<int8_t>(field_[static_cast<size_t>(a.y) * width_ + a.x]
+                          & BIT_BW)};
+  }
+  if (++history_pos_ == FF_HISTORY_SIZE) {
+    history_pos_ = 0;
+  }
+  history_len_ = std::min(history_len_ + 1, FF_HISTORY_SIZE);
+}
+
+// back = 0 is the state before the last generation
+const la_cpu_engine::history_entry& la_cpu_engine::history(
+    size_t ant, size_t back) const {
+  const size_t slot =
+    (history_pos_ + FF_HISTORY_SIZE - 1 - back) % FF_HISTORY_SIZE;
+  return history_[ant * FF_HISTORY_SIZE + slot];
+}
+
+/*
+  Smallest period P such that the direction and colour seen by the ant
+  over the last 3P generations repeat every P generations, or 0.
+*/
+size_t la_cpu_engine::find_period(size_t ant) const {
+  for (size_t p = 1; 3 * p <= history_len_ && p <= FF_MAX_PERIOD; ++p) {
+    bool periodic = true;
+    for (size_t t = 0; t < 2 * p; ++t) {
+      const history_entry& e1 = history(ant, t);
+      const history_entry& e2 = history(ant, t + p);
+      if (e1.d != e2.d || e1.c != e2.c) {
+        periodic = false;
+        break;
+      }
+    }
+    if (periodic) {
+      return p;
+    }
+  }
+  return 0;
+}
+
+/*
+  Jump all ants forward by the same number of whole periods, at most
+  max_steps generations. Returns the number of generations skipped.
+
+  Over the last period an ant started at p0 and touched the squares
+  p0 + s (s in S), finding colour c0(s) on its first visit and leaving
+  f(s). It ends at p0 + D with its initial direction. Period j of the
+  jump repeats the last one shifted by j * D as long as every square it
+  touches holds c0(s) when the period starts. A square last touched by
+  period j - k, k = next(s) the smallest k >= 1 with s + k * D in S,
+  holds f(s + k * D); any other square still holds its current colour.
+*/
+size_t la_cpu_engine::try_fast_forward(size_t max_steps) {
+  struct square {
+    int64_t sx;
+    int64_t sy;
+    int8_t c0;
+    int8_t f;
+    size_t next;  // k such that s + k * D in S, or 0
+    size_t prev;  // k such that s - k * D in S, or 0
+  };
+  struct highway {
+    int64_t x0;
+    int64_t y0;
+    int64_t dx;
+    int64_t dy;
+    int64_t min_x, min_y, max_x, max_y;  // bounding box of S
+    std::vector<square> squares;
+  };
+  const size_t n_ants = ants_.size();
+  size_t period = 0;
+  for (size_t i = 0; i < n_ants; ++i) {
+    const size_t p = find_period(i);
+    if (p == 0 || (period != 0 && p != period)) {
+      return 0;
+    }
+    period = p;
+  }
+  if (max_steps / period == 0) {
+    return 0;
+  }
+  auto at = [this](int64_t x, int64_t y) -> int8_t& {
+    return field_[static_cast<size_t>(y) * width_ + static_cast<size_t>(x)];
+  };
+  auto key = [](int64_t x, int64_t y) {
+    return (static_cast<uint64_t>(y) << 32) ^ static_cast<uint32_t>(x);
+  };
+  std::vector<highway> highways(n_ants);
+  size_t m = max_steps / period;
+  for (size_t i = 0; i < n_ants; ++i) {
+    highway& h = highways[i];
+    const history_entry& start = history(i, period - 1);
+    h.x0 = start.x;
+    h.y0 = start.y;
+    // replay the last period relative to p0
+    std::unordered_map<uint64_t, size_t> index;
+    int64_t x = 0;
+    int64_t y = 0;
+    for (size_t t = period; t-- > 0;) {
+      const history_entry& e = history(i, t);
+      auto found = index.find(key(x, y));
+      if (found == index.end()) {
+        index[key(x, y)] = h.squares.size();
+        h.squares.push_back(square{x, y, e.c, e.c, 0, 0});
+      }
+      square& sq = h.squares[index[key(x, y)]];
+      sq.f = (~sq.f) & BIT_BW;
+      move(turn(e.d, e.c), x, y);
+    }
+    h.dx = x;
+    h.dy = y;
+    if (h.dx == 0 && h.dy == 0) {
+      return 0;
+    }
+    h.min_x = h.max_x = h.min_y = h.max_y = 0;
+    for (square& sq : h.squares) {
+      h.min_x = std::min(h.min_x, sq.sx);
+      h.max_x = std::max(h.max_x, sq.sx);
+      h.min_y = std::min(h.min_y, sq.sy);
+      h.max_y = std::max(h.max_y, sq.sy);
+      for (size_t k = 1; k <= period && sq.next == 0; ++k) {
+        if (index.count(key(sq.sx + k * h.dx, sq.sy + k * h.dy))) {
+          sq.next = k;
+        }
+      }
+      for (size_t k = 1; k <= period && sq.prev == 0; ++k) {
+        if (index.count(key(sq.sx - k * h.dx, sq.sy - k * h.dy))) {
+          sq.prev = k;
+        }
+      }
+    }
+    // the last period must not straddle the wraparound edge
+    if (h.x0 + h.min_x < 0 || h.x0 + h.max_x >= width_ ||
+        h.y0 + h.min_y < 0 || h.y0 + h.max_y >= height_) {
+      return 0;
+    }
+    for (const square& sq : h.squares) {
+      // nothing else touched the squares since the last period
+      if (at(h.x0 + sq.sx, h.y0 + sq.sy) != sq.f) {
+        return 0;
+      }
+      // a square revisited by a later period must be left as found
+      if (sq.next != 0) {
+        const square& later = h.squares[index[key(sq.sx + sq.next * h.dx,
+                                                  sq.sy + sq.next * h.dy)]];
+        if (later.f != sq.c0) {
+          return 0;
+        }
+      }
+    }
+    // longest run of periods that find their squares as expected
+    size_t mi = 0;
+    while (mi < m) {
+      const int64_t j = mi + 1;
+      const int64_t ox = h.x0 + j * h.dx;
+      const int64_t oy = h.y0 + j * h.dy;
+      if (ox + h.min_x < 0 || ox + h.max_x >= width_ ||
+          oy + h.min_y < 0 || oy + h.max_y >= height_) {
+        break;
+      }
+      bool ok = true;
+      for (const square& sq : h.squares) {
+        if ((sq.next == 0 || static_cast<int64_t>(sq.next) > j) &&
+            at(ox + sq.sx, oy + sq.sy) != sq.c0) {
+          ok = false;
+          break;
+        }
+      }
+      if (!ok) {
+        break;
+      }
+      mi = j;
+    }
+    m = std::min(m, mi);
+  }
+  // the stripes of different ants must stay apart
+  auto overlap = [&](size_t m) {
+    for (size_t i = 0; i < n_ants; ++i) {
+      for (size_t k = i + 1; k < n_ants; ++k) {
+        const highway& a = highways[i];
+        const highway& b = highways[k];
+        const int64_t ax0 = a.x0 + a.min_x + std::min<int64_t>(0, m * a.dx);
+        const int64_t ax1 = a.x0 + a.max_x + std::max<int64_t>(0, m * a.dx);
+        const int64_t ay0 = a.y0 + a.min_y + std::min<int64_t>(0, m * a.dy);
+        const int64_t ay1 = a.y0 + a.max_y + std::max<int64_t>(0, m * a.dy);
+        const int64_t bx0 = b.x0 + b.min_x + std::min<int64_t>(0, m * b.dx);
+        const int64_t bx1 = b.x0 + b.max_x + std::max<int64_t>(0, m * b.dx);
+        const int64_t by0 = b.y0 + b.min_y + std::min<int64_t>(0, m * b.dy);
+        const int64_t by1 = b.y0 + b.max_y + std::max<int64_t>(0, m * b.dy);
+        if (ax0 <= bx1 + 1 && bx0 <= ax1 + 1 &&
+            ay0 <= by1 + 1 && by0 <= ay1 + 1) {
+          return true;
+        }
+      }
+    }
+    return false;
+  };
+  while (m > 0 && overlap(m)) {
+    m /= 2;
+  }
+  if (m == 0) {
+    return 0;
+  }
+  for (size_t i = 0; i < n_ants; ++i) {
+    const highway& h = highways[i];
+    for (size_t j = 1; j <= m; ++j) {
+      const int64_t ox = h.x0 + static_cast<int64_t>(j) * h.dx;
+      const int64_t oy = h.y0 + static_cast<int64_t>(j) * h.dy;
+      for (const square& sq : h.squares) {
+        // skip squares that a later period of the jump overwrites
+        if (sq.prev == 0 || j + sq.prev > m) {
+          at(ox + sq.sx, oy + sq.sy) = sq.f;
+        }
+      }
+    }
+    la_ant& a = ants_[i];
+    int64_t x = h.x0 + static_cast<int64_t>(m + 1) * h.dx;
+    int64_t y = h.y0 + static_cast<int64_t>(m + 1) * h.dy;
+    a.x = static_cast<int32_t>(((x % width_) + width_) % width_);
+    a.y = static_cast<int32_t>(((y % height_) + height_) % height_);
+  }
+  history_len_ = 0;
+  return m * period;
+}
+
+/*
+  Same as la_rotate_and_flip followed by la_forward.
+*/
+void la_cpu_engine::step_dense() {
+  const int width = width_;
+  const int height = height_;
+  int8_t* const field = &field_.front();
+  int8_t* const work = &work_.front();
+  const la_rule rule = rule_;
+  const bool rl = la_rule_is_rl(rule);
+
+#pragma omp parallel
+  {
+#pragma omp for schedule(static)
+    for (int y = 0; y < height; ++y) {
+      const int8_t* src = field + static_cast<size_t>(y) * width;
+      int8_t* dst = work + static_cast<size_t>(y) * width;
+      if (!rl) {
+        for (int x = 0; x < width; ++x) {
+          dst[x] = rotate_square(src[x], rule);
+        }
+        continue;
+      }
+      for (int x = 0; x < width; ++x) {
+        const int8_t c = src[x];
+        int8_t c_bw = c & BIT_BW;
+        const int8_t c_ants = c & BITS_NEWS;
+        if (c_ants == 0) {
+          dst[x] = c_bw;
+          continue;
+        }
+        int8_t c_news;
+        if (!c_bw) {
+          // At a white square, turn 90° clockwise
+          c_news = ((c_ants << 1) | (c_ants >> 3)) & BITS_NEWS;
+        } else {
+          // At a black square, turn 90° counterclockwise
+          c_news = ((c_ants >> 1) | (c_ants << 3)) & BITS_NEWS;
+        }
+        // flip the color of the square
+        c_bw = (~c_bw) & BIT_BW;
+        dst[x] = c_news | c_bw;
+      }
+    }
+    // implicit barrier: every row is rotated before any ant moves
+#pragma omp for schedule(static)
+    for (int y = 0; y < height; ++y) {
+      const int8_t* row = work + static_cast<size_t>(y) * width;
+      const int8_t* row_n =
+        work + static_cast<size_t>((y == 0) ? height - 1 : y - 1) * width;
+      const int8_t* row_s =
+        work + static_cast<size_t>((y == height - 1) ? 0 : y + 1) * width;
+      int8_t* dst = field + static_cast<size_t>(y) * width;
+      for (int x = 0; x < width; ++x) {
+        const int x_w = (x == 0) ? width - 1 : x - 1;
+        const int x_e = (x == width - 1) ? 0 : x + 1;
+        const int8_t c_news =
+          (row_s[x] & BIT_N) |
+          (row[x_w] & BIT_E) |
+          (row_n[x] & BIT_S) |
+          (row[x_e] & BIT_W);
+        dst[x] = c_news | (row[x] & BITS_COLOUR);
+      }
+    }
+  }
+}
+
+template <bool RL>
+static inline void rotate_ant(la_ant& a, const int8_t* field, int width,
+                              const la_rule& rule) {
+  const int8_t c = field[static_cast<size_t>(a.y) * width + a.x];
+  if (RL) {
+    const int8_t c_bw = c & BIT_BW;
+    a.d = turn(a.d, c_bw);
+    // flip the color of the square
+    a.c = (~c_bw) & BIT_BW;
+    return;
+  }
+  const int colour = (c & BITS_COLOUR) >> COLOUR_SHIFT;
+  const int t = la_rule_turn(rule, colour);
+  a.d = ((a.d << t) | (a.d >> (4 - t))) & BITS_NEWS;
+  a.c = ((colour + 1 == rule.colours) ? 0 : colour + 1) << COLOUR_SHIFT;
+}
+
+static inline void forward_ant(la_ant& a, int8_t* field,
+                               int width, int height) {
+  // ants sharing a square store the same colour
+  __atomic_store_n(&field[static_cast<size_t>(a.y) * width + a.x],
+                   static_cast<int8_t>(a.c), __ATOMIC_RELAXED);
+  if (a.d == BIT_N) {
+    a.y = (a.y == 0) ? height - 1 : a.y - 1;
+  } else if (a.d == BIT_E) {
+    a.x = (a.x == width - 1) ? 0 : a.x + 1;
+  } else if (a.d == BIT_S) {
+    a.y = (a.y == height - 1) ? 0 : a.y + 1;
+  } else {
+    a.x = (a.x == 0) ? width - 1 : a.x - 1;
+  }
+}
+
+/*
+  Same as la_ants_rotate followed by la_ants_forward. RL skips the rule
+  lookup.
+*/
+template <bool RL>
+void la_cpu_engine::step_sparse() {
+  const int width = width_;
+  const int height = height_;
+  const long n = static_cast<long>(ants_.size());
+  int8_t* const field = &field_.front();
+  la_ant* const ants = ants_.data();
+  const la_rule rule = rule_;
+
+  if (ants_.size() < PARALLEL_MIN_ANTS) {
+    for (long i = 0; i < n; ++i) {
+      rotate_ant<RL>(ants[i], field, width, rule);
+    }
+    for (long i = 0; i < n; ++i) {
+      forward_ant(ants[i], field, width, height);
+    }
+    return;
+  }
+#pragma omp parallel
+  {
+#pragma omp for schedule(static)
+    for (long i = 0; i < n; ++i) {
+      rotate_ant<RL>(ants[i], field, width, rule);
+    }
+    // implicit barrier: every ant has read its square before any flip
+#pragma omp for schedule(static)
+    for (long i = 0; i < n; ++i) {
+      forward_ant(ants[i], field, width, height);
+    }
+  }
+}
+
+void la_cpu_engine::read_field(std::vector<int8_t>& field) const {
+  if (memo_) {
+    memo_->read_field(field);
+    return;
+  }
+  if (plane_) {
+    plane_->read_field(field);
+    return;
+  }
+  field = field_;
+  for (const la_ant& a : ants_) {
+    field[static_cast<size_t>(a.y) * width_ + a.x] |= a.d;
+  }
+}
+
+void la_cpu_engine::ant_positions(std::vector<la_ant>& positions) const {
+  if (memo_) {
+    memo_->ant_positions(positions);
+    return;
+  }
+  if (plane_) {
+    plane_->ant_positions(positions);
+    return;
+  }
+  if (sparse_) {
+    positions = ants_;
+    for (la_ant& a : positions) {
+      a.c = field_[static_cast<size_t>(a.y) * width_ + a.x] & BITS_COLOUR;
+    }
+    return;
+  }
+  positions.clear();
+#pragma omp parallel
+  {
+    std::vector<la_ant> found;
+#pragma omp for schedule(static) nowait
+    for (int y = 0; y < height_; ++y) {
+      const int8_t* row = &field_[static_cast<size_t>(y) * width_];
+      for (int x = 0; x < width_; ++x) {
+        if ((row[x] & BITS_NEWS) != 0) {
+          found.push_back(la_ant{x, y, row[x] & BITS_NEWS,
+                                 row[x] & BITS_COLOUR});
+        }
+      }
+    }
+#pragma omp critical
+    positions.insert(positions.end(), found.begin(), found.end());
+  }
+}
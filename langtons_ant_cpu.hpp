@@ -0,0 +1,186 @@
+#ifndef LANGTONS_ANT_CPU_HPP_
+#define LANGTONS_ANT_CPU_HPP_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <memory>
+#include <vector>
+
+// ----------------------------------------------------------------------
+// cell encoding, shared with langtons_ant_kernel.cl
+// ----------------------------------------------------------------------
+#define BIT_N (1 << 0)
+#define BIT_E (1 << 1)
+#define BIT_S (1 << 2)
+#define BIT_W (1 << 3)
+#define BIT_BW (1 << 4)
+
+#define BITS_NEWS 0x0f
+
+// colour of the square with a --rule of more than two colours; BIT_BW is
+// its lowest bit, so colour 1 is black
+#define COLOUR_SHIFT 4
+#define BITS_COLOUR (7 << COLOUR_SHIFT)
+
+// same layout as la_ant in langtons_ant_kernel.cl
+struct la_ant {
+  int32_t x;
+  int32_t y;
+  int32_t d;  // BIT_N, BIT_E, BIT_S or BIT_W
+  int32_t c;  // colour of the square after flipping
+};
+
+/*
+  Rule of a generalised ant, a turmite with one state: on a square of
+  colour k the ant turns turns[k] quarter turns clockwise, and the square
+  takes colour k + 1, modulo colours. Written as one letter per colour,
+  R (right), L (left), N (no turn) or U (u-turn); "RL" is Langton's ant.
+*/
+struct la_rule {
+  int colours;     // 2 to 8
+  uint32_t turns;  // 2 bits per colour, colour 0 lowest
+};
+
+static const int LA_RULE_MAX_COLOURS = 8;
+
+// Parse a rule string such as "RLR" or "LLRR", false if it is not one.
+bool la_parse_rule(const char* s, la_rule& rule);
+
+// Langton's ant, the rule of the one-bit encoding.
+inline la_rule la_rule_rl() {
+  return la_rule{2, 1u | (3u << 2)};
+}
+
+inline bool la_rule_is_rl(const la_rule& rule) {
+  return rule.colours == 2 && rule.turns == la_rule_rl().turns;
+}
+
+// Quarter turns clockwise on colour.
+inline int la_rule_turn(const la_rule& rule, int colour) {
+  return (rule.turns >> (2 * colour)) & 3;
+}
+
+/*
+  Take the ants out of a field in the dense layout.
+  Every direction bit of a square becomes one ant, and the square is left
+  with its colour only.
+*/
+void la_extract_ants(std::vector<int8_t>& field, int width, int height,
+                     std::vector<la_ant>& ants);
+
+// ----------------------------------------------------------------------
+// native engine
+// ----------------------------------------------------------------------
+
+class la_memo_engine;
+class la_plane_engine;
+
+/*
+  Native multithreaded implementation of la_rotate_and_flip/la_forward.
+
+  In dense mode the whole field is swept row by row with OpenMP.
+  In sparse mode only the squares under the ants are touched, and the
+  ants are distributed over the threads.
+
+  With fast forward enabled (sparse mode, few ants), the engine watches
+  the recent moves of every ant. Once all of them repeat with the same
+  period and a non-zero drift, as on the period-104 highway, it checks
+  that the squares ahead are exactly as the last period found them and
+  jumps every ant many periods at once, writing the trail in bulk. The
+  jump stops short of other ants' trails, of squares that do not match
+  and of the wraparound edge, so the result is the same as stepping.
+
+  In memo mode the work is handed to la_memo_engine, in plane mode to
+  la_plane_engine.
+
+  Rules other than RL (set_rule) run in dense and sparse mode only, with
+  the colour in BITS_COLOUR.
+*/
+class la_cpu_engine {
+ public:
+  enum mode_t {
+    MODE_AUTO,
+    MODE_DENSE,
+    MODE_SPARSE,
+    MODE_MEMO,
+    MODE_PLANE,
+  };
+
+  la_cpu_engine(int width, int height,
+                const std::vector<int8_t>& field_init,
+                mode_t mode = MODE_AUTO);
+  ~la_cpu_engine();
+
+  // Run n generations.
+  void step(size_t n);
+
+  // Enable highway detection and fast forward (sparse mode, RL only).
+  void set_fast_forward(bool enable);
+
+  // Rule of the ants, RL by default (dense and sparse mode).
+  void set_rule(const la_rule& rule);
+
+  // Whether fast forward is active.
+  bool fast_forwarding() const { return fast_forward_; }
+
+  // Generations skipped by fast forward so far.
+  size_t fast_forwarded() const { return fast_forwarded_; }
+
+  // Current field in the dense layout.
+  void read_field(std::vector<int8_t>& field) const;
+
+  // The field being stepped, width * height squares in the dense layout,
+  // without copying; 0 in memo and plane mode. In sparse mode it holds
+  // the colours only. Valid until the next step.
+  const int8_t* field_data() const {
+    return field_.empty() ? 0 : &field_.front();
+  }
+
+  // Squares occupied by ants, for drawing.
+  // The c member is set to the current colour of the square.
+  void ant_positions(std::vector<la_ant>& positions) const;
+
+  bool sparse() const { return sparse_; }
+
+  // The memoizing engine in memo mode, 0 otherwise.
+  const la_memo_engine* memo() const { return memo_.get(); }
+
+  // The unbounded engine in plane mode, 0 otherwise.
+  const la_plane_engine* plane() const { return plane_.get(); }
+
+ private:
+  // state of an ant before one generation
+  struct history_entry {
+    int32_t x;
+    int32_t y;
+    int8_t d;
+    int8_t c;  // colour of the square
+  };
+
+  void step_dense();
+  template <bool RL> void step_sparse();
+  void record_history();
+  const history_entry& history(size_t ant, size_t back) const;
+  size_t find_period(size_t ant) const;
+  size_t try_fast_forward(size_t max_steps);
+
+  int width_;
+  int height_;
+  bool sparse_;
+  la_rule rule_;
+  std::vector<int8_t> field_;
+  std::vector<int8_t> work_;
+  std::vector<la_ant> ants_;
+  std::unique_ptr<la_memo_engine> memo_;
+  std::unique_ptr<la_plane_engine> plane_;
+
+  bool fast_forward_;
+  size_t fast_forwarded_;
+  size_t check_interval_;
+  size_t steps_since_check_;
+  size_t history_len_;  // valid entries per ant
+  size_t history_pos_;  // next ring slot
+  std::vector<history_entry> history_;  // ring of FF_HISTORY_SIZE per ant
+};
+
+#endif  // LANGTONS_ANT_CPU_HPP_
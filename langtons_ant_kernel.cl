@@ -6,39 +6,87 @@
 
 #define BITS_NEWS 0x0f
 
+// colour of the square; only BIT_BW is used by the default RL rule
+#define COLOUR_SHIFT 4
+#define BITS_COLOUR (7 << COLOUR_SHIFT)
+
+#ifdef LA_FIELD_TILES
+/*
+  --layout tiles, built with -D LA_FIELD_TILES: the field is stored as
+  tiles of 8x8 squares, 64 bytes each, the tiles row by row, so that the
+  squares above and below are mostly in the same cache line. stride, the
+  squares per row, is a multiple of 8, and the host pads the rows to one.
+*/
+#define TILE_SHIFT 3
+#define TILE_MASK ((1 << TILE_SHIFT) - 1)
+
+int field_index(const int x, const int y, const int stride) {
+  const int tile =
+    (y >> TILE_SHIFT) * (stride >> TILE_SHIFT) + (x >> TILE_SHIFT);
+  return (tile << (2 * TILE_SHIFT)) | ((y & TILE_MASK) << TILE_SHIFT)
+    | (x & TILE_MASK);
+}
+#else
+int field_index(const int x, const int y, const int stride) {
+  return y * stride + x;
+}
+#endif
+
+/*
+  v wrapped into [0, n), for v in [-n, 2n), without branching: the
+  comparisons give 0 or 1, negated into an all-ones mask.
+*/
+int wrap(const int v, const int n) {
+  return v + (n & -(v < 0)) - (n & -(v >= n));
+}
+
+/*
+  Square (x, y) of a width x height torus, x in [-width, 2 * width) and y
+  in [-height, 2 * height).
+*/
 char get(
     __global unsigned char *map,
-    int x,
-    int y,
-    int width,
-    int height) {
-  if (x < 0) {
-    x += width;
-  } else if (x >= width) {
-    x -= width;
-  }
-  if (y < 0) {
-    y += height;
-  } else if (y >= height) {
-    y -= height;
-  }
-  return map[y * width + x];
+    const int x,
+    const int y,
+    const int width,
+    const int height,
+    const int stride) {
+  return map[field_index(wrap(x, width), wrap(y, height), stride)];
+}
+
+#ifdef LA_RULE_COLOURS
+/*
+  --rule other than RL, built with -D LA_RULE_COLOURS=n and
+  -D LA_RULE_TURNS=t, t holding the quarter turns clockwise of every
+  colour in 2 bits (la_rule in langtons_ant_cpu.hpp): turn the ants by
+  the colour of the square and advance the colour.
+*/
+int rule_turn(const int colour) {
+  return (LA_RULE_TURNS >> (2 * colour)) & 3;
+}
+
+int rule_next(const int colour) {
+  return (colour + 1 == LA_RULE_COLOURS) ? 0 : colour + 1;
 }
 
+char rotate_and_flip(const char c) {
+  const int c_ants = c & BITS_NEWS;
+  if (c_ants == 0) {
+    return c & BITS_COLOUR;
+  }
+  const int colour = (c & BITS_COLOUR) >> COLOUR_SHIFT;
+  const int t = rule_turn(colour);
+  const int c_news = ((c_ants << t) | (c_ants >> (4 - t))) & BITS_NEWS;
+  return c_news | (rule_next(colour) << COLOUR_SHIFT);
+}
+#else
 /*
   - At a white square, turn 90° clockwise,
     flip the color of the square.
   - At a black square, turn 90° counterclockwise,
     flip the color of the square.
 */
-__kernel void la_rotate_and_flip(
-    __global unsigned char *src,
-    __global unsigned char *dst) {
-  const int width = get_global_size(0);
-  const int height = get_global_size(0);
-  const int x = get_global_id(0);
-  const int y = get_global_id(1);
-  const char c = get(src, x, y, width, height);
+char rotate_and_flip(const char c) {
   char c_news = 0;
   char c_bw = c & BIT_BW;
   if (!c_bw) {
@@ -60,7 +108,28 @@ __kernel void la_rotate_and_flip(
     // flip the color of the square
     c_bw = (~c_bw) & BIT_BW;
   }
-  dst[y * width + x] = c_news | c_bw;
+  return c_news | c_bw;
+}
+#endif
+
+/*
+  The field kernels take the size of the field and the squares per row
+  of its buffer; work-items beyond the field, when the global size is
+  rounded up to the work-group size, do nothing.
+*/
+__kernel void la_rotate_and_flip(
+    __global unsigned char *src,
+    __global unsigned char *dst,
+    const int width,
+    const int height,
+    const int stride) {
+  const int x = get_global_id(0);
+  const int y = get_global_id(1);
+  if (x >= width || y >= height) {
+    return;
+  }
+  const int i = field_index(x, y, stride);
+  dst[i] = rotate_and_flip(src[i]);
 }
 
 /*
@@ -68,16 +137,20 @@ __kernel void la_rotate_and_flip(
 */
 __kernel void la_forward(
     __global unsigned char *src,
-    __global unsigned char *dst) {
-  const int width = get_global_size(0);
-  const int height = get_global_size(0);
+    __global unsigned char *dst,
+    const int width,
+    const int height,
+    const int stride) {
   const int x = get_global_id(0);
   const int y = get_global_id(1);
-  const char c_n = get(src, x, y - 1, width, height);
-  const char c_e = get(src, x + 1, y, width, height);
-  const char c_s = get(src, x, y + 1, width, height);
-  const char c_w = get(src, x - 1, y, width, height);
-  const char c = get(src, x, y, width, height);
+  if (x >= width || y >= height) {
+    return;
+  }
+  const char c_n = get(src, x, y - 1, width, height, stride);
+  const char c_e = get(src, x + 1, y, width, height, stride);
+  const char c_s = get(src, x, y + 1, width, height, stride);
+  const char c_w = get(src, x - 1, y, width, height, stride);
+  const char c = src[field_index(x, y, stride)];
   char c_news = 0;
   if ((c_s & BIT_N) != 0) {
     c_news |= BIT_N;
@@ -91,22 +164,407 @@ __kernel void la_forward(
   if ((c_e & BIT_W) != 0) {
     c_news |= BIT_W;
   }
-  const char c_bw = c & BIT_BW;
-  dst[y * width + x] = c_news | c_bw;
+  dst[field_index(x, y, stride)] = c_news | (c & BITS_COLOUR);
+}
+
+/*
+  la_rotate_and_flip and la_forward in one pass.
+  The work-group loads its tile plus a one-square halo into local memory,
+  rotating and flipping on the way, then each work-item gathers the ants
+  entering its square from the tile.
+  tile must hold (local_size(0) + 2) * (local_size(1) + 2) squares.
+  Work-items beyond the field still take part in the load, which skips
+  the squares past the halo of the field.
+*/
+__kernel void la_step_fused(
+    __global unsigned char *src,
+    __global unsigned char *dst,
+    __local unsigned char *tile,
+    const int width,
+    const int height,
+    const int stride) {
+  const int lw = get_local_size(0);
+  const int lh = get_local_size(1);
+  const int tw = lw + 2;
+  const int th = lh + 2;
+  const int x0 = get_group_id(0) * lw - 1;
+  const int y0 = get_group_id(1) * lh - 1;
+  for (int i = get_local_id(1) * lw + get_local_id(0);
+       i < tw * th; i += lw * lh) {
+    const int sx = x0 + i % tw;
+    const int sy = y0 + i / tw;
+    tile[i] = (sx <= width && sy <= height)
+      ? rotate_and_flip(get(src, sx, sy, width, height, stride)) : 0;
+  }
+  barrier(CLK_LOCAL_MEM_FENCE);
+  const int x = get_global_id(0);
+  const int y = get_global_id(1);
+  if (x >= width || y >= height) {
+    return;
+  }
+  const int tx = get_local_id(0) + 1;
+  const int ty = get_local_id(1) + 1;
+  const char c_n = tile[(ty - 1) * tw + tx];
+  const char c_e = tile[ty * tw + tx + 1];
+  const char c_s = tile[(ty + 1) * tw + tx];
+  const char c_w = tile[ty * tw + tx - 1];
+  const char c = tile[ty * tw + tx];
+  const char c_news =
+    (c_s & BIT_N) | (c_w & BIT_E) | (c_n & BIT_S) | (c_e & BIT_W);
+  dst[field_index(x, y, stride)] = c_news | (c & BITS_COLOUR);
+}
+
+/*
+  Strip engine: one horizontal strip of the field per device, with a
+  halo row above and below copied from the neighbouring strips after
+  every step. src and dst hold rows + 2 rows of width squares; work-item
+  (x, y) computes row y + 1 as la_rotate_and_flip followed by la_forward.
+  Rows wrap around here; the halo rows take care of the top and bottom.
+*/
+__kernel void la_strip_step(
+    __global unsigned char *src,
+    __global unsigned char *dst,
+    const int width) {
+  const int x = get_global_id(0);
+  const int y = get_global_id(1) + 1;
+  const int x_w = (x == 0) ? width - 1 : x - 1;
+  const int x_e = (x == width - 1) ? 0 : x + 1;
+  const char c_n = rotate_and_flip(src[(y - 1) * width + x]);
+  const char c_e = rotate_and_flip(src[y * width + x_e]);
+  const char c_s = rotate_and_flip(src[(y + 1) * width + x]);
+  const char c_w = rotate_and_flip(src[y * width + x_w]);
+  const char c = rotate_and_flip(src[y * width + x]);
+  const char c_news =
+    (c_s & BIT_N) | (c_w & BIT_E) | (c_n & BIT_S) | (c_e & BIT_W);
+  dst[y * width + x] = c_news | (c & BITS_COLOUR);
+}
+
+/*
+  Ensemble: independent fields of width x height squares one after the
+  other, work-item (x, y, run) stepping square (x, y) of field run as
+  la_rotate_and_flip followed by la_forward.
+*/
+__kernel void la_ensemble_step(
+    __global unsigned char *src,
+    __global unsigned char *dst,
+    const int width,
+    const int height) {
+  const int x = get_global_id(0);
+  const int y = get_global_id(1);
+  if (x >= width || y >= height) {
+    return;
+  }
+  const size_t base = get_global_id(2) * (size_t)width * height;
+  __global unsigned char *field = src + base;
+  const char c_n = rotate_and_flip(get(field, x, y - 1, width, height, width));
+  const char c_e = rotate_and_flip(get(field, x + 1, y, width, height, width));
+  const char c_s = rotate_and_flip(get(field, x, y + 1, width, height, width));
+  const char c_w = rotate_and_flip(get(field, x - 1, y, width, height, width));
+  const char c = rotate_and_flip(field[field_index(x, y, width)]);
+  const char c_news =
+    (c_s & BIT_N) | (c_w & BIT_E) | (c_n & BIT_S) | (c_e & BIT_W);
+  dst[base + field_index(x, y, width)] = c_news | (c & BITS_COLOUR);
+}
+
+/*
+  Add the black squares and the ants of row get_global_id(0) of field
+  get_global_id(1) to stats[2 * run] and stats[2 * run + 1].
+*/
+__kernel void la_ensemble_stats(
+    __global unsigned char *field,
+    __global unsigned int *stats,
+    const int width,
+    const int height) {
+  const int y = get_global_id(0);
+  const int run = get_global_id(1);
+  __global unsigned char *row =
+    field + ((size_t)run * height + y) * width;
+  unsigned int black = 0;
+  unsigned int ants = 0;
+  for (int x = 0; x < width; ++x) {
+    const unsigned char c = row[x];
+    black += (c & BITS_COLOUR) ? 1 : 0;
+    ants += popcount((unsigned char)(c & BITS_NEWS));
+  }
+  if (black != 0) {
+    atomic_add(&stats[2 * run], black);
+  }
+  if (ants != 0) {
+    atomic_add(&stats[2 * run + 1], ants);
+  }
+}
+
+/*
+  Sparse engine: each work-item owns one ant.
+  The field holds only the colours; ants live in a separate array.
+*/
+typedef struct {
+  int x;
+  int y;
+  int d;  // BIT_N, BIT_E, BIT_S or BIT_W
+  int c;  // colour of the square after flipping
+} la_ant;
+
+#ifdef LA_RULE_COLOURS
+// c_colour is the colour bits of the square, as in rotate_and_flip
+void ant_rotate(la_ant *a, const char c_colour) {
+  const int colour = (c_colour & BITS_COLOUR) >> COLOUR_SHIFT;
+  const int t = rule_turn(colour);
+  a->d = ((a->d << t) | (a->d >> (4 - t))) & BITS_NEWS;
+  a->c = rule_next(colour) << COLOUR_SHIFT;
+}
+#else
+void ant_rotate(la_ant *a, const char c_bw) {
+  if (!c_bw) {
+    // At a white square, turn 90° clockwise
+    a->d = (a->d == BIT_W) ? BIT_N : (a->d << 1);
+  } else {
+    // At a black square, turn 90° counterclockwise
+    a->d = (a->d == BIT_N) ? BIT_W : (a->d >> 1);
+  }
+  // flip the color of the square
+  a->c = (~c_bw) & BIT_BW;
+}
+#endif
+
+void ant_forward(la_ant *a, const int width, const int height) {
+  if (a->d == BIT_N) {
+    a->y = (a->y == 0) ? height - 1 : a->y - 1;
+  } else if (a->d == BIT_E) {
+    a->x = (a->x == width - 1) ? 0 : a->x + 1;
+  } else if (a->d == BIT_S) {
+    a->y = (a->y == height - 1) ? 0 : a->y + 1;
+  } else {
+    a->x = (a->x == 0) ? width - 1 : a->x - 1;
+  }
+}
+
+/*
+  Turn the ant according to the colour of its square.
+  The square itself is not written here, so that several ants on the
+  same square all see the same colour, as in la_rotate_and_flip.
+*/
+__kernel void la_ants_rotate(
+    __global unsigned char *field,
+    __global la_ant *ants,
+    const int width,
+    const int height,
+    const int stride) {
+  const int i = get_global_id(0);
+  la_ant a = ants[i];
+  ant_rotate(&a, field[field_index(a.x, a.y, stride)] & BITS_COLOUR);
+  ants[i] = a;
+}
+
+/*
+  Flip the square and move the ant forward one unit.
+  Ants sharing a square write the same colour, so no atomics are needed.
+*/
+__kernel void la_ants_forward(
+    __global unsigned char *field,
+    __global la_ant *ants,
+    const int width,
+    const int height,
+    const int stride) {
+  const int i = get_global_id(0);
+  la_ant a = ants[i];
+  field[field_index(a.x, a.y, stride)] = a.c;
+  ant_forward(&a, width, height);
+  ants[i] = a;
+}
+
+/*
+  Packed engine: the colours are kept as one bit per square in 32-bit
+  words, stride words per row, and the ants in the la_ant array.
+*/
+char packed_bw(__global unsigned int *field, const int stride,
+               const int x, const int y) {
+  return ((field[y * stride + (x >> 5)] >> (x & 31)) & 1) ? BIT_BW : 0;
+}
+
+__kernel void la_packed_ants_rotate(
+    __global unsigned int *field,
+    __global la_ant *ants,
+    const int stride) {
+  const int i = get_global_id(0);
+  la_ant a = ants[i];
+  ant_rotate(&a, packed_bw(field, stride, a.x, a.y));
+  ants[i] = a;
+}
+
+/*
+  Other ants may write other bits of the same word, hence the atomics.
+  Ants sharing a square still set the bit to the same value.
+*/
+__kernel void la_packed_ants_forward(
+    __global unsigned int *field,
+    __global la_ant *ants,
+    const int stride,
+    const int width,
+    const int height) {
+  const int i = get_global_id(0);
+  la_ant a = ants[i];
+  __global unsigned int *word = &field[a.y * stride + (a.x >> 5)];
+  const unsigned int bit = 1u << (a.x & 31);
+  if (a.c) {
+    atomic_or(word, bit);
+  } else {
+    atomic_and(word, ~bit);
+  }
+  ant_forward(&a, width, height);
+  ants[i] = a;
+}
+
+/*
+  Statistics, accumulated into stats by la_field_stats and
+  la_packed_stats: black squares, ants, squares holding several ants,
+  and the bounding box of the black squares. stats must start as
+  { 0, 0, 0, UINT_MAX, UINT_MAX, 0, 0 }. Every work-group reduces its
+  part in local memory first, so that only one work-item per group
+  touches stats.
+*/
+#define STATS_BLACK 0
+#define STATS_ANTS 1
+#define STATS_COLLISIONS 2
+#define STATS_X0 3
+#define STATS_Y0 4
+#define STATS_X1 5
+#define STATS_Y1 6
+#define STATS_SIZE 7
+
+void stats_begin(__local unsigned int *l) {
+  if (get_local_id(0) == 0 && get_local_id(1) == 0) {
+    l[STATS_BLACK] = 0;
+    l[STATS_ANTS] = 0;
+    l[STATS_COLLISIONS] = 0;
+    l[STATS_X0] = UINT_MAX;
+    l[STATS_Y0] = UINT_MAX;
+    l[STATS_X1] = 0;
+    l[STATS_Y1] = 0;
+  }
+  barrier(CLK_LOCAL_MEM_FENCE);
+}
+
+void stats_end(__local unsigned int *l, __global unsigned int *stats) {
+  barrier(CLK_LOCAL_MEM_FENCE);
+  if (get_local_id(0) != 0 || get_local_id(1) != 0) {
+    return;
+  }
+  if (l[STATS_BLACK] != 0) {
+    atomic_add(&stats[STATS_BLACK], l[STATS_BLACK]);
+    atomic_min(&stats[STATS_X0], l[STATS_X0]);
+    atomic_min(&stats[STATS_Y0], l[STATS_Y0]);
+    atomic_max(&stats[STATS_X1], l[STATS_X1]);
+    atomic_max(&stats[STATS_Y1], l[STATS_Y1]);
+  }
+  if (l[STATS_ANTS] != 0) {
+    atomic_add(&stats[STATS_ANTS], l[STATS_ANTS]);
+  }
+  if (l[STATS_COLLISIONS] != 0) {
+    atomic_add(&stats[STATS_COLLISIONS], l[STATS_COLLISIONS]);
+  }
+}
+
+/*
+  One work-item per square of a field of one byte per square (the dense,
+  fused and sparse engines; the sparse field holds no ants).
+*/
+__kernel void la_field_stats(
+    __global unsigned char *field,
+    __global unsigned int *stats,
+    const int width,
+    const int height,
+    const int stride) {
+  __local unsigned int l[STATS_SIZE];
+  stats_begin(l);
+  const int x = get_global_id(0);
+  const int y = get_global_id(1);
+  if (x < width && y < height) {
+    const unsigned char c = field[field_index(x, y, stride)];
+    const unsigned int ants = popcount((unsigned char)(c & BITS_NEWS));
+    if ((c & BITS_COLOUR) != 0) {
+      atomic_inc(&l[STATS_BLACK]);
+      atomic_min(&l[STATS_X0], (unsigned int)x);
+      atomic_min(&l[STATS_Y0], (unsigned int)y);
+      atomic_max(&l[STATS_X1], (unsigned int)x);
+      atomic_max(&l[STATS_Y1], (unsigned int)y);
+    }
+    if (ants != 0) {
+      atomic_add(&l[STATS_ANTS], ants);
+      if (ants > 1) {
+        atomic_inc(&l[STATS_COLLISIONS]);
+      }
+    }
+  }
+  stats_end(l, stats);
+}
+
+/*
+  One work-item per word of the packed engine; the ants are not in the
+  field.
+*/
+__kernel void la_packed_stats(
+    __global unsigned int *field,
+    __global unsigned int *stats,
+    const int stride,
+    const int height) {
+  __local unsigned int l[STATS_SIZE];
+  stats_begin(l);
+  const int i = get_global_id(0);
+  const int y = get_global_id(1);
+  if (i < stride && y < height) {
+    const unsigned int w = field[y * stride + i];
+    if (w != 0) {
+      atomic_add(&l[STATS_BLACK], popcount(w));
+      atomic_min(&l[STATS_X0], i * 32 + 31 - clz(w & -w));
+      atomic_min(&l[STATS_Y0], (unsigned int)y);
+      atomic_max(&l[STATS_X1], i * 32 + 31 - clz(w));
+      atomic_max(&l[STATS_Y1], (unsigned int)y);
+    }
+  }
+  stats_end(l, stats);
+}
+
+/*
+  The image is a one-channel texture of palette indices, turned into
+  colours by the fragment shader (palette in langtons_ant.cpp).
+*/
+#define PALETTE_UNSEEN 0    // white, never drawn
+#define PALETTE_BW_CLEAR 1  // black
+#define PALETTE_BW_SET 2    // light red
+#define PALETTE_BLACK 3     // black squares in the view
+#define PALETTE_ANT 4       // ants in the view
+#define PALETTE_OUTSIDE 5   // off the field in the view
+#define PALETTE_COLOURS 6   // colours 2 and up of a --rule
+
+void write_palette(__write_only image2d_t image, const int2 pos,
+                   const int index) {
+  write_imagef(image, pos, (float4)(index / 255.0f, 0.0f, 0.0f, 1.0f));
+}
+
+int palette_index(const char c_colour) {
+#ifdef LA_RULE_COLOURS
+  const int colour = (c_colour & BITS_COLOUR) >> COLOUR_SHIFT;
+  if (colour > 1) {
+    return PALETTE_COLOURS + colour - 2;
+  }
+#endif
+  return (c_colour != 0) ? PALETTE_BW_SET : PALETTE_BW_CLEAR;
 }
 
 /*
   Clear field image (fill white)
  */
 __kernel void la_clear_image(
-    __write_only image2d_t image) {
-  const int width = get_global_size(0);
-  const int height = get_global_size(0);
+    __write_only image2d_t image,
+    const int width,
+    const int height) {
   const int x = get_global_id(0);
   const int y = get_global_id(1);
-  const float r = 1.0, g = 1.0, b = 1.0;
-  const float4 pixel = (float4)(r, g, b, 1.0);
-  write_imagef(image, (int2)(x,y), pixel);
+  if (x >= width || y >= height) {
+    return;
+  }
+  write_palette(image, (int2)(x,y), PALETTE_UNSEEN);
 }
 
 /*
@@ -114,26 +572,161 @@ __kernel void la_clear_image(
  */
 __kernel void la_draw_image(
     __global unsigned char *field,
+    const int width,
+    const int height,
+    const int stride,
     __write_only image2d_t image) {
-  const int width = get_global_size(0);
-  const int height = get_global_size(0);
   const int x = get_global_id(0);
   const int y = get_global_id(1);
-  const char c = get(field, x, y, width, height);
-  float r, g, b;
+  if (x >= width || y >= height) {
+    return;
+  }
+  const char c = field[field_index(x, y, stride)];
   if ((c & BITS_NEWS) == 0) {
     return;
   }
-  if ((c & BIT_BW) != 0) {
-    r = 1.0;
-    g = 0.8;
-    b = 0.8;
-  } else {
-    // black
-    r = 0.0;
-    g = 0.0;
-    b = 0.0;
+  write_palette(image, (int2)(x,y), palette_index(c & BITS_COLOUR));
+}
+
+/*
+  Draw the squares under the ants of the sparse engine
+ */
+__kernel void la_ants_draw_image(
+    __global unsigned char *field,
+    __global la_ant *ants,
+    const int stride,
+    __write_only image2d_t image) {
+  const int i = get_global_id(0);
+  const la_ant a = ants[i];
+  const char c = field[field_index(a.x, a.y, stride)];
+  write_palette(image, (int2)(a.x,a.y), palette_index(c & BITS_COLOUR));
+}
+
+/*
+  Draw the squares under the ants of the packed engine
+ */
+__kernel void la_packed_ants_draw_image(
+    __global unsigned int *field,
+    __global la_ant *ants,
+    const int stride,
+    __write_only image2d_t image) {
+  const int i = get_global_id(0);
+  const la_ant a = ants[i];
+  write_palette(image, (int2)(a.x,a.y),
+                palette_index(packed_bw(field, stride, a.x, a.y)));
+}
+
+/*
+  Level-of-detail view: the window is drawn at its own resolution from
+  the field, scaled by zoom and translated by (tx, ty) as display_cb does
+  with the whole field texture, so the cost follows the window size
+  rather than the field size.
+
+  Squares [*s0, *s1) of the n squares of the field lie under pixel p of
+  the m pixels of the window along one axis; false if none does.
+*/
+bool view_span(const int p, const int m, const int n,
+               const float zoom, const float t, int *s0, int *s1) {
+  const float o0 = ((2.0f * p / m - 1.0f) / zoom - t + 1.0f) * 0.5f * n;
+  const float o1 =
+    ((2.0f * (p + 1) / m - 1.0f) / zoom - t + 1.0f) * 0.5f * n;
+  *s0 = (int)clamp(floor(o0), 0.0f, (float)n);
+  *s1 = (int)clamp(ceil(o1), 0.0f, (float)n);
+  return *s0 < *s1;
+}
+
+// At most VIEW_SAMPLES x VIEW_SAMPLES squares, evenly spread, are read
+// per pixel.
+#define VIEW_SAMPLES 8
+
+/*
+  Pixel (get_global_id(0), get_global_id(1)) of the view of a field of
+  one byte per square, stride squares per row: PALETTE_ANT if any square
+  read holds an ant, PALETTE_BLACK if any is black, white otherwise.
+*/
+__kernel void la_view_field(
+    __global unsigned char *field,
+    const int stride,
+    const int width,
+    const int height,
+    const float zoom,
+    const float tx,
+    const float ty,
+    __write_only image2d_t image) {
+  const int px = get_global_id(0);
+  const int py = get_global_id(1);
+  int x0, x1, y0, y1;
+  if (!view_span(px, get_global_size(0), width, zoom, tx, &x0, &x1)
+      || !view_span(py, get_global_size(1), height, zoom, ty, &y0, &y1)) {
+    write_palette(image, (int2)(px,py), PALETTE_OUTSIDE);
+    return;
+  }
+  const int sx = (x1 - x0 + VIEW_SAMPLES - 1) / VIEW_SAMPLES;
+  const int sy = (y1 - y0 + VIEW_SAMPLES - 1) / VIEW_SAMPLES;
+  unsigned char any = 0;
+  for (int y = y0; y < y1; y += sy) {
+    for (int x = x0; x < x1; x += sx) {
+      any |= field[field_index(x, y, stride)];
+    }
+  }
+  write_palette(image, (int2)(px,py),
+                ((any & BITS_NEWS) != 0) ? PALETTE_ANT
+                : ((any & BITS_COLOUR) != 0) ? PALETTE_BLACK : PALETTE_UNSEEN);
+}
+
+/*
+  Same as la_view_field for the packed engine, stride words per row.
+  The ants are drawn afterwards by la_view_ants.
+*/
+__kernel void la_view_packed(
+    __global unsigned int *field,
+    const int stride,
+    const int width,
+    const int height,
+    const float zoom,
+    const float tx,
+    const float ty,
+    __write_only image2d_t image) {
+  const int px = get_global_id(0);
+  const int py = get_global_id(1);
+  int x0, x1, y0, y1;
+  if (!view_span(px, get_global_size(0), width, zoom, tx, &x0, &x1)
+      || !view_span(py, get_global_size(1), height, zoom, ty, &y0, &y1)) {
+    write_palette(image, (int2)(px,py), PALETTE_OUTSIDE);
+    return;
+  }
+  const int sx = (x1 - x0 + VIEW_SAMPLES - 1) / VIEW_SAMPLES;
+  const int sy = (y1 - y0 + VIEW_SAMPLES - 1) / VIEW_SAMPLES;
+  char any = 0;
+  for (int y = y0; y < y1; y += sy) {
+    for (int x = x0; x < x1; x += sx) {
+      any |= packed_bw(field, stride, x, y);
+    }
+  }
+  write_palette(image, (int2)(px,py),
+                (any != 0) ? PALETTE_BLACK : PALETTE_UNSEEN);
+}
+
+/*
+  Mark the pixels of the view under the ants of the sparse and packed
+  engines, whose fields hold no ants.
+*/
+__kernel void la_view_ants(
+    __global la_ant *ants,
+    const int width,
+    const int height,
+    const float zoom,
+    const float tx,
+    const float ty,
+    const int view_width,
+    const int view_height,
+    __write_only image2d_t image) {
+  const la_ant a = ants[get_global_id(0)];
+  const float sx = ((a.x + 0.5f) / width * 2.0f - 1.0f + tx) * zoom;
+  const float sy = ((a.y + 0.5f) / height * 2.0f - 1.0f + ty) * zoom;
+  const int px = (int)floor((sx + 1.0f) * 0.5f * view_width);
+  const int py = (int)floor((sy + 1.0f) * 0.5f * view_height);
+  if (px >= 0 && px < view_width && py >= 0 && py < view_height) {
+    write_palette(image, (int2)(px,py), PALETTE_ANT);
   }
-  const float4 pixel = (float4)(r, g, b, 1.0);
-  write_imagef(image, (int2)(x,y), pixel);
 }
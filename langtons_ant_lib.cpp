@@ -0,0 +1,138 @@
+#include <string.h>
+#include <exception>
+#include <memory>
+#include <string>
+#include <vector>
+#include "langtons_ant.h"
+#include "langtons_ant_cpu.hpp"
+
+static_assert(sizeof(la_sim_ant) == sizeof(la_ant),
+              "la_sim_ant and la_ant differ");
+
+struct la_sim {
+  int width;
+  int height;
+  uint64_t steps;
+  std::unique_ptr<la_cpu_engine> engine;
+  std::vector<int8_t> field;      // expanded field of cpu-memo and cpu-plane
+  std::vector<la_ant> ants;       // positions at ants_step
+  uint64_t ants_step;             // UINT64_MAX: not read yet
+};
+
+static thread_local std::string last_error;
+
+static bool la_sim_parse_engine(const char* name,
+                                la_cpu_engine::mode_t& mode) {
+  if (name == 0 || strcmp(name, "cpu") == 0) {
+    mode = la_cpu_engine::MODE_AUTO;
+  } else if (strcmp(name, "cpu-dense") == 0) {
+    mode = la_cpu_engine::MODE_DENSE;
+  } else if (strcmp(name, "cpu-sparse") == 0) {
+    mode = la_cpu_engine::MODE_SPARSE;
+  } else if (strcmp(name, "cpu-memo") == 0) {
+    mode = la_cpu_engine::MODE_MEMO;
+  } else if (strcmp(name, "cpu-plane") == 0) {
+    mode = la_cpu_engine::MODE_PLANE;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+la_sim* la_sim_create(int width, int height, const int8_t* field,
+                      const char* engine, const char* rule) {
+  if (width <= 0 || height <= 0) {
+    last_error = "the field needs a positive width and height";
+    return 0;
+  }
+  la_cpu_engine::mode_t mode;
+  if (!la_sim_parse_engine(engine, mode)) {
+    last_error = std::string("unknown engine ") + engine
+      + ", expected cpu, cpu-dense, cpu-sparse, cpu-memo or cpu-plane";
+    return 0;
+  }
+  la_rule r = la_rule_rl();
+  if (rule != 0 && !la_parse_rule(rule, r)) {
+    last_error = std::string("unknown rule ") + rule
+      + ", expected 2 to 8 of the letters R, L, N and U";
+    return 0;
+  }
+  if (!la_rule_is_rl(r)
+      && (mode == la_cpu_engine::MODE_MEMO
+          || mode == la_cpu_engine::MODE_PLANE)) {
+    last_error = "cpu-memo and cpu-plane need the rule RL";
+    return 0;
+  }
+  try {
+    const size_t n = static_cast<size_t>(width) * height;
+    std::vector<int8_t> field_init(n, 0);
+    if (field != 0) {
+      field_init.assign(field, field + n);
+    }
+    std::unique_ptr<la_sim> sim(new la_sim());
+    sim->width = width;
+    sim->height = height;
+    sim->steps = 0;
+    sim->engine.reset(new la_cpu_engine(width, height, field_init, mode));
+    sim->engine->set_rule(r);
+    sim->ants_step = UINT64_MAX;
+    return sim.release();
+  } catch (const std::exception& e) {
+    last_error = e.what();
+    return 0;
+  }
+}
+
+void la_sim_destroy(la_sim* sim) {
+  delete sim;
+}
+
+int la_sim_step(la_sim* sim, uint64_t n) {
+  // a step that fails partway still moves the ants, with steps behind
+  sim->ants_step = UINT64_MAX;
+  try {
+    sim->engine->step(n);
+  } catch (const std::exception& e) {
+    last_error = e.what();
+    return -1;
+  }
+  sim->steps += n;
+  return 0;
+}
+
+uint64_t la_sim_steps(const la_sim* sim) {
+  return sim->steps;
+}
+
+void la_sim_set_fast_forward(la_sim* sim, int enable) {
+  sim->engine->set_fast_forward(enable != 0);
+}
+
+const int8_t* la_sim_map_field(la_sim* sim) {
+  const int8_t* data = sim->engine->field_data();
+  if (data != 0) {
+    return data;
+  }
+  sim->engine->read_field(sim->field);
+  return &sim->field.front();
+}
+
+size_t la_sim_get_ants(la_sim* sim, la_sim_ant* ants, size_t max) {
+  // cpu-dense finds its ants by scanning the field, so keep them until
+  // the next step rather than scanning for the count and again for the
+  // copy
+  if (sim->ants_step != sim->steps) {
+    sim->engine->ant_positions(sim->ants);
+    sim->ants_step = sim->steps;
+  }
+  const size_t n = sim->ants.size();
+  if (ants != 0 && n != 0) {
+    memcpy(ants, &sim->ants.front(),
+           sizeof(la_sim_ant) * ((n < max) ? n : max));
+  }
+  return n;
+}
+
+const char* la_sim_error(void) {
+  return last_error.c_str();
+}
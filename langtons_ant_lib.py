@@ -0,0 +1,173 @@
+# -*- mode:python;coding:utf-8 -*-
+import argparse
+import ctypes
+import os
+import time
+from typing import Optional
+import numpy as np
+
+# cell encoding of the dense layout, as in langtons_ant_cpu.hpp
+BIT_N = 1 << 0
+BIT_E = 1 << 1
+BIT_S = 1 << 2
+BIT_W = 1 << 3
+BITS_NEWS = 0x0f
+COLOUR_SHIFT = 4
+BITS_COLOUR = 7 << COLOUR_SHIFT
+
+# la_sim_ant of langtons_ant.h
+ANT_DTYPE = np.dtype([('x', np.int32), ('y', np.int32),
+                      ('d', np.int32), ('c', np.int32)])
+
+def load_library(path : Optional[str] = None) -> ctypes.CDLL:
+    if path is None:
+        path = os.path.join(os.path.dirname(os.path.abspath(__file__)),
+                            'liblangtons_ant.so')
+    lib = ctypes.CDLL(path)
+    lib.la_sim_create.restype = ctypes.c_void_p
+    lib.la_sim_create.argtypes = [ctypes.c_int, ctypes.c_int,
+                                  ctypes.c_void_p,
+                                  ctypes.c_char_p, ctypes.c_char_p]
+    lib.la_sim_destroy.restype = None
+    lib.la_sim_destroy.argtypes = [ctypes.c_void_p]
+    lib.la_sim_step.restype = ctypes.c_int
+    lib.la_sim_step.argtypes = [ctypes.c_void_p, ctypes.c_uint64]
+    lib.la_sim_steps.restype = ctypes.c_uint64
+    lib.la_sim_steps.argtypes = [ctypes.c_void_p]
+    lib.la_sim_set_fast_forward.restype = None
+    lib.la_sim_set_fast_forward.argtypes = [ctypes.c_void_p, ctypes.c_int]
+    lib.la_sim_map_field.restype = ctypes.POINTER(ctypes.c_int8)
+    lib.la_sim_map_field.argtypes = [ctypes.c_void_p]
+    lib.la_sim_get_ants.restype = ctypes.c_size_t
+    lib.la_sim_get_ants.argtypes = [ctypes.c_void_p, ctypes.c_void_p,
+                                    ctypes.c_size_t]
+    lib.la_sim_error.restype = ctypes.c_char_p
+    lib.la_sim_error.argtypes = []
+    return lib
+
+class Simulation:
+    """
+    Langton's ant on a torus, stepped by the native engines of
+    liblangtons_ant (make liblangtons_ant.so). With engine 'cpu-plane'
+    the field is a window onto the unbounded plane instead: ants walk
+    off its edges, and field() and ants() show what is inside it.
+    """
+    def __init__(self, field : np.ndarray,
+                 engine : str = 'cpu', rule : str = 'RL',
+                 lib : Optional[ctypes.CDLL] = None) -> None:
+        self.sim = None
+        self.lib = lib if lib is not None else load_library()
+        field = np.ascontiguousarray(field, dtype = np.int8)
+        self.height, self.width = field.shape
+        self.sim = self.lib.la_sim_create(self.width, self.height,
+                                          field.ctypes.data,
+                                          engine.encode(), rule.encode())
+        if not self.sim:
+            raise RuntimeError(self.lib.la_sim_error().decode())
+
+    @classmethod
+    def random(cls, height : int, width : int, ants : int,
+               seed : Optional[int] = None, **kwargs) -> 'Simulation':
+        rng = np.random.default_rng(seed)
+        field = np.zeros((height, width), dtype = np.int8)
+        ys = rng.integers(0, height, ants)
+        xs = rng.integers(0, width, ants)
+        field[ys, xs] = 1 << rng.integers(0, 4, ants)
+        return cls(field, **kwargs)
+
+    def close(self) -> None:
+        if self.sim:
+            self.lib.la_sim_destroy(self.sim)
+            self.sim = None
+
+    def __enter__(self) -> 'Simulation':
+        return self
+
+    def __exit__(self, *args) -> None:
+        self.close()
+
+    def __del__(self) -> None:
+        self.close()
+
+    def step(self, n : int = 1) -> None:
+        if self.lib.la_sim_step(self.sim, n) != 0:
+            raise RuntimeError(self.lib.la_sim_error().decode())
+
+    @property
+    def steps(self) -> int:
+        return self.lib.la_sim_steps(self.sim)
+
+    def set_fast_forward(self, enable : bool) -> None:
+        self.lib.la_sim_set_fast_forward(self.sim, int(enable))
+
+    def field(self) -> np.ndarray:
+        """
+        The field as a read-only (height, width) view of the engine's
+        memory, not a copy: valid until the next step, so copy it to keep
+        or modify it.
+        """
+        ptr = self.lib.la_sim_map_field(self.sim)
+        field = np.ctypeslib.as_array(ptr, shape = (self.height, self.width))
+        field.flags.writeable = False
+        return field
+
+    def colours(self) -> np.ndarray:
+        return (self.field() & BITS_COLOUR) >> COLOUR_SHIFT
+
+    def ants(self) -> np.ndarray:
+        n = self.lib.la_sim_get_ants(self.sim, None, 0)
+        ants = np.empty(n, dtype = ANT_DTYPE)
+        if n:
+            self.lib.la_sim_get_ants(self.sim, ants.ctypes.data, n)
+        return ants
+
+def main() -> None:
+    parser = argparse.ArgumentParser()
+    parser.add_argument("-W", "--width",
+                        type = int,
+                        default = 1024,
+                        help = "Field width (default 1024)")
+    parser.add_argument("-H", "--height",
+                        type = int,
+                        default = 1024,
+                        help = "Field height (default 1024)")
+    parser.add_argument("-n", "--ants",
+                        type = int,
+                        default = 20,
+                        help = "Number of ants (default 20)")
+    parser.add_argument("-c", "--count",
+                        type = int,
+                        default = 1000000,
+                        help = "Step count (default 1000000)")
+    parser.add_argument("-e", "--engine",
+                        type = str,
+                        default = 'cpu',
+                        help = "cpu, cpu-dense, cpu-sparse, cpu-memo or cpu-plane")
+    parser.add_argument("-r", "--rule",
+                        type = str,
+                        default = 'RL',
+                        help = "Rule, RL by default")
+    parser.add_argument("-s", "--seed",
+                        type = int,
+                        default = 8,
+                        help = "Random seed")
+    parser.add_argument("-o", "--output",
+                        type = str,
+                        help = "Save the final field as an image (ex. field.png)")
+    args = parser.parse_args()
+
+    with Simulation.random(args.height, args.width, args.ants, args.seed,
+                           engine = args.engine, rule = args.rule) as sim:
+        start = time.perf_counter()
+        sim.step(args.count)
+        elapsed = time.perf_counter() - start
+        black = np.count_nonzero(sim.colours())
+        print('steps: {} in {:.3f} s ({:.0f} steps/s), black squares: {}, ants: {}'
+              .format(sim.steps, elapsed, args.count / elapsed, black,
+                      len(sim.ants())))
+        if args.output:
+            import matplotlib.pyplot as plt
+            plt.imsave(args.output, sim.colours(), cmap = 'Greys')
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,230 @@
+#include <stdlib.h>
+#include <algorithm>
+#include "langtons_ant_memo.hpp"
+
+// Block side. The last column and row of blocks are narrower when the
+// width or height is not a multiple of it.
+static const int MEMO_BLOCK = 8;
+
+// Longest walk computed inside one block. Langton's ant always leaves a
+// bounded region, this only bounds the work of a single lookup.
+static const uint32_t MEMO_MAX_WALK = 65536;
+
+// Slots in the table (a power of 2).
+static const size_t MEMO_ENTRIES = 1 << 20;
+
+// Ants that could meet within this many generations step together.
+static const size_t MEMO_MIN_ROUND = 16;
+
+static inline int32_t turn(int32_t d, bool black) {
+  if (!black) {
+    // At a white square, turn 90° clockwise
+    return (d == BIT_W) ? BIT_N : (d << 1);
+  }
+  // At a black square, turn 90° counterclockwise
+  return (d == BIT_N) ? BIT_W : (d >> 1);
+}
+
+static inline uint64_t square_bit(int32_t x, int32_t y) {
+  return 1ULL << ((y % MEMO_BLOCK) * MEMO_BLOCK + (x % MEMO_BLOCK));
+}
+
+la_memo_engine::la_memo_engine(int width, int height,
+                               const std::vector<int8_t>& field,
+                               const std::vector<la_ant>& ants)
+  : width_(width), height_(height),
+    blocks_x_((width + MEMO_BLOCK - 1) / MEMO_BLOCK),
+    blocks_(static_cast<size_t>(blocks_x_)
+            * ((height + MEMO_BLOCK - 1) / MEMO_BLOCK)),
+    ants_(ants), cache_(MEMO_ENTRIES, entry{0, 0, 0xffff, 0, 0, 0, 0}),
+    hits_(0), misses_(0) {
+  for (int32_t y = 0; y < height; ++y) {
+    for (int32_t x = 0; x < width; ++x) {
+      if ((field[static_cast<size_t>(y) * width + x] & BIT_BW) != 0) {
+        block(x, y) |= square_bit(x, y);
+      }
+    }
+  }
+}
+
+uint64_t& la_memo_engine::block(int32_t x, int32_t y) {
+  return blocks_[static_cast<size_t>(y / MEMO_BLOCK) * blocks_x_
+                 + x / MEMO_BLOCK];
+}
+
+uint64_t la_memo_engine::block(int32_t x, int32_t y) const {
+  return blocks_[static_cast<size_t>(y / MEMO_BLOCK) * blocks_x_
+                 + x / MEMO_BLOCK];
+}
+
+/*
+  Walk of an ant entering a block of bw x bh squares (8x8 but at the
+  right and bottom edges) with the given pattern at (lx, ly) facing d,
+  until it leaves the block.
+*/
+const la_memo_engine::entry& la_memo_engine::lookup(
+    uint64_t pattern, int lx, int ly, int32_t d, int bw, int bh) {
+  const uint16_t state = ((bh - 1) << 12) | ((bw - 1) << 9)
+    | (__builtin_ctz(d) << 6) | (ly << 3) | lx;
+  const uint64_t hash =
+    (pattern ^ (pattern >> 29) ^ state) * 0x9e3779b97f4a7c15ULL;
+  entry& e = cache_[(hash >> 32) & (MEMO_ENTRIES - 1)];
+  if (e.state == state && e.pattern == pattern) {
+    ++hits_;
+    return e;
+  }
+  ++misses_;
+  e.pattern = pattern;
+  e.state = state;
+  int x = lx;
+  int y = ly;
+  uint32_t steps = 0;
+  while (x >= 0 && x < bw && y >= 0 && y < bh && steps < MEMO_MAX_WALK) {
+    const uint64_t bit = 1ULL << (y * MEMO_BLOCK + x);
+    d = turn(d, (pattern & bit) != 0);
+    // flip the color of the square
+    pattern ^= bit;
+    if (d == BIT_N) {
+      --y;
+    } else if (d == BIT_E) {
+      ++x;
+    } else if (d == BIT_S) {
+      ++y;
+    } else {
+      --x;
+    }
+    ++steps;
+  }
+  e.result = pattern;
+  e.x = x;
+  e.y = y;
+  e.d = d;
+  e.steps = steps;
+  return e;
+}
+
+/*
+  Run one ant alone for n generations.
+*/
+void la_memo_engine::advance(la_ant& a, size_t n) {
+  while (n > 0) {
+    const int32_t x0 = a.x - a.x % MEMO_BLOCK;
+    const int32_t y0 = a.y - a.y % MEMO_BLOCK;
+    uint64_t& b = block(a.x, a.y);
+    const entry& r = lookup(b, a.x - x0, a.y - y0, a.d,
+                            std::min(MEMO_BLOCK, width_ - x0),
+                            std::min(MEMO_BLOCK, height_ - y0));
+    if (r.steps <= n) {
+      b = r.result;
+      a.x = (x0 + r.x + width_) % width_;
+      a.y = (y0 + r.y + height_) % height_;
+      a.d = r.d;
+      n -= r.steps;
+      continue;
+    }
+    // the walk is longer than what is left: go square by square
+    for (; n > 0; --n) {
+      const uint64_t bit = square_bit(a.x, a.y);
+      uint64_t& c = block(a.x, a.y);
+      a.d = turn(a.d, (c & bit) != 0);
+      c ^= bit;
+      if (a.d == BIT_N) {
+        a.y = (a.y == 0) ? height_ - 1 : a.y - 1;
+      } else if (a.d == BIT_E) {
+        a.x = (a.x == width_ - 1) ? 0 : a.x + 1;
+      } else if (a.d == BIT_S) {
+        a.y = (a.y == height_ - 1) ? 0 : a.y + 1;
+      } else {
+        a.x = (a.x == 0) ? width_ - 1 : a.x - 1;
+      }
+    }
+  }
+}
+
+/*
+  Same as la_ants_rotate followed by la_ants_forward.
+*/
+void la_memo_engine::step_together() {
+  for (la_ant& a : ants_) {
+    const bool black = (block(a.x, a.y) & square_bit(a.x, a.y)) != 0;
+    a.d = turn(a.d, black);
+    // flip the color of the square
+    a.c = black ? 0 : BIT_BW;
+  }
+  for (la_ant& a : ants_) {
+    // ants sharing a square store the same colour
+    const uint64_t bit = square_bit(a.x, a.y);
+    uint64_t& c = block(a.x, a.y);
+    c = (a.c != 0) ? (c | bit) : (c & ~bit);
+    if (a.d == BIT_N) {
+      a.y = (a.y == 0) ? height_ - 1 : a.y - 1;
+    } else if (a.d == BIT_E) {
+      a.x = (a.x == width_ - 1) ? 0 : a.x + 1;
+    } else if (a.d == BIT_S) {
+      a.y = (a.y == height_ - 1) ? 0 : a.y + 1;
+    } else {
+      a.x = (a.x == 0) ? width_ - 1 : a.x - 1;
+    }
+  }
+}
+
+/*
+  Smallest distance between two ants, counting diagonal moves as one and
+  across the wraparound edges.
+*/
+size_t la_memo_engine::separation() const {
+  size_t dist = static_cast<size_t>(std::max(width_, height_));
+  for (size_t i = 0; i < ants_.size(); ++i) {
+    for (size_t k = i + 1; k < ants_.size(); ++k) {
+      int dx = abs(ants_[i].x - ants_[k].x);
+      int dy = abs(ants_[i].y - ants_[k].y);
+      dx = std::min(dx, width_ - dx);
+      dy = std::min(dy, height_ - dy);
+      dist = std::min(dist, static_cast<size_t>(std::max(dx, dy)));
+    }
+  }
+  return dist;
+}
+
+void la_memo_engine::step(size_t n) {
+  while (n > 0) {
+    size_t round = n;
+    if (ants_.size() > 1) {
+      // in r generations an ant touches squares at most r - 1 away
+      // from where it started
+      round = std::min(n, (separation() + 1) / 2);
+      if (round < MEMO_MIN_ROUND) {
+        const size_t k = std::min(n, MEMO_MIN_ROUND);
+        for (size_t i = 0; i < k; ++i) {
+          step_together();
+        }
+        n -= k;
+        continue;
+      }
+    }
+    for (la_ant& a : ants_) {
+      advance(a, round);
+    }
+    n -= round;
+  }
+}
+
+void la_memo_engine::read_field(std::vector<int8_t>& field) const {
+  field.resize(static_cast<size_t>(width_) * height_);
+  for (int32_t y = 0; y < height_; ++y) {
+    for (int32_t x = 0; x < width_; ++x) {
+      field[static_cast<size_t>(y) * width_ + x] =
+        ((block(x, y) & square_bit(x, y)) != 0) ? BIT_BW : 0;
+    }
+  }
+  for (const la_ant& a : ants_) {
+    field[static_cast<size_t>(a.y) * width_ + a.x] |= a.d;
+  }
+}
+
+void la_memo_engine::ant_positions(std::vector<la_ant>& positions) const {
+  positions = ants_;
+  for (la_ant& a : positions) {
+    a.c = ((block(a.x, a.y) & square_bit(a.x, a.y)) != 0) ? BIT_BW : 0;
+  }
+}
@@ -0,0 +1,78 @@
+#ifndef LANGTONS_ANT_MEMO_HPP_
+#define LANGTONS_ANT_MEMO_HPP_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+#include "langtons_ant_cpu.hpp"
+
+// ----------------------------------------------------------------------
+// memoizing engine
+// ----------------------------------------------------------------------
+
+/*
+  Memoizing engine for one or a few ants.
+
+  The colours are kept as 8x8 blocks of one bit per square in a uint64_t,
+  the blocks of the last column and row cut to the width and height.
+  The walk of an ant through a block only depends on the block pattern
+  and the square and direction it enters with, so the outcome (new
+  pattern, exit square and direction, generations taken) is computed
+  once and looked up in a hash table afterwards: an ant crosses a block
+  in one lookup instead of square by square. The table is direct mapped:
+  a new walk replaces whatever shared its slot.
+
+  Ants run alone for as many generations as they cannot possibly meet,
+  half their smallest distance. Ants closer than that step together one
+  generation at a time, with the same rules as the other engines.
+*/
+class la_memo_engine {
+ public:
+  // field holds the colours only; the ants are given separately
+  la_memo_engine(int width, int height, const std::vector<int8_t>& field,
+                 const std::vector<la_ant>& ants);
+
+  // Run n generations.
+  void step(size_t n);
+
+  // Current field in the dense layout.
+  void read_field(std::vector<int8_t>& field) const;
+
+  // Ants with the current colour of their square in c.
+  void ant_positions(std::vector<la_ant>& positions) const;
+
+  // Block lookups found in the table, and those computed.
+  size_t hits() const { return hits_; }
+  size_t misses() const { return misses_; }
+
+ private:
+  struct entry {
+    uint64_t pattern;  // block before the walk
+    uint64_t result;   // block after the walk
+    uint16_t state;    // block size, entry square and direction,
+                       // 0xffff if unused
+    int8_t x;  // square after the walk, relative to the block (-1 to 8)
+    int8_t y;
+    int8_t d;
+    uint32_t steps;
+  };
+
+  uint64_t& block(int32_t x, int32_t y);
+  uint64_t block(int32_t x, int32_t y) const;
+  const entry& lookup(uint64_t pattern, int lx, int ly, int32_t d,
+                      int bw, int bh);
+  void advance(la_ant& a, size_t n);
+  void step_together();
+  size_t separation() const;
+
+  int width_;
+  int height_;
+  int blocks_x_;  // blocks per row
+  std::vector<uint64_t> blocks_;
+  std::vector<la_ant> ants_;
+  std::vector<entry> cache_;
+  size_t hits_;
+  size_t misses_;
+};
+
+#endif  // LANGTONS_ANT_MEMO_HPP_
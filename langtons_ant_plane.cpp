@@ -0,0 +1,165 @@
+#include <algorithm>
+#include "langtons_ant_plane.hpp"
+
+// Chunk side (log2 and squares), one uint64_t per row.
+static const int PLANE_CHUNK_SHIFT = 6;
+static const int32_t PLANE_CHUNK = 1 << PLANE_CHUNK_SHIFT;
+
+static inline int32_t turn(int32_t d, bool black) {
+  if (!black) {
+    // At a white square, turn 90° clockwise
+    return (d == BIT_W) ? BIT_N : (d << 1);
+  }
+  // At a black square, turn 90° counterclockwise
+  return (d == BIT_N) ? BIT_W : (d >> 1);
+}
+
+la_plane_engine::la_plane_engine(int width, int height,
+                                 const std::vector<int8_t>& field,
+                                 const std::vector<la_ant>& ants)
+  : width_(width), height_(height), ants_(ants) {
+  for (int32_t y = 0; y < height; ++y) {
+    for (int32_t x = 0; x < width; ++x) {
+      if ((field[static_cast<size_t>(y) * width + x] & BIT_BW) != 0) {
+        get(x >> PLANE_CHUNK_SHIFT, y >> PLANE_CHUNK_SHIFT)
+          ->rows[y & (PLANE_CHUNK - 1)] |= 1ULL << (x & (PLANE_CHUNK - 1));
+      }
+    }
+  }
+  for (const la_ant& a : ants_) {
+    const int32_t cx = a.x >> PLANE_CHUNK_SHIFT;
+    const int32_t cy = a.y >> PLANE_CHUNK_SHIFT;
+    cursors_.push_back(cursor{get(cx, cy), cx, cy});
+  }
+}
+
+uint64_t la_plane_engine::key(int32_t cx, int32_t cy) {
+  return (static_cast<uint64_t>(static_cast<uint32_t>(cy)) << 32)
+    | static_cast<uint32_t>(cx);
+}
+
+const la_plane_engine::chunk* la_plane_engine::find(int32_t cx,
+                                                    int32_t cy) const {
+  auto found = chunks_.find(key(cx, cy));
+  return (found == chunks_.end()) ? 0 : found->second.get();
+}
+
+// the chunk, allocated white if it does not exist yet
+la_plane_engine::chunk* la_plane_engine::get(int32_t cx, int32_t cy) {
+  std::unique_ptr<chunk>& c = chunks_[key(cx, cy)];
+  if (!c) {
+    c.reset(new chunk());
+  }
+  return c.get();
+}
+
+bool la_plane_engine::black(int32_t x, int32_t y) const {
+  const chunk* c = find(x >> PLANE_CHUNK_SHIFT, y >> PLANE_CHUNK_SHIFT);
+  return c != 0
+    && ((c->rows[y & (PLANE_CHUNK - 1)] >> (x & (PLANE_CHUNK - 1))) & 1);
+}
+
+/*
+  Same as la_ants_rotate followed by la_ants_forward, without wrapping.
+*/
+void la_plane_engine::step(size_t n) {
+  const size_t n_ants = ants_.size();
+  for (size_t i = 0; i < n; ++i) {
+    for (size_t k = 0; k < n_ants; ++k) {
+      la_ant& a = ants_[k];
+      const uint64_t row = cursors_[k].c->rows[a.y & (PLANE_CHUNK - 1)];
+      const bool c_bw = (row >> (a.x & (PLANE_CHUNK - 1))) & 1;
+      a.d = turn(a.d, c_bw);
+      // flip the color of the square
+      a.c = c_bw ? 0 : BIT_BW;
+    }
+    for (size_t k = 0; k < n_ants; ++k) {
+      la_ant& a = ants_[k];
+      cursor& cur = cursors_[k];
+      // ants sharing a square store the same colour
+      uint64_t& row = cur.c->rows[a.y & (PLANE_CHUNK - 1)];
+      const uint64_t bit = 1ULL << (a.x & (PLANE_CHUNK - 1));
+      row = (a.c != 0) ? (row | bit) : (row & ~bit);
+      if (a.d == BIT_N) {
+        --a.y;
+      } else if (a.d == BIT_E) {
+        ++a.x;
+      } else if (a.d == BIT_S) {
+        ++a.y;
+      } else {
+        --a.x;
+      }
+      const int32_t cx = a.x >> PLANE_CHUNK_SHIFT;
+      const int32_t cy = a.y >> PLANE_CHUNK_SHIFT;
+      if (cx != cur.cx || cy != cur.cy) {
+        cur = cursor{get(cx, cy), cx, cy};
+      }
+    }
+  }
+}
+
+void la_plane_engine::read_field(std::vector<int8_t>& field) const {
+  field.resize(static_cast<size_t>(width_) * height_);
+  for (int32_t y = 0; y < height_; ++y) {
+    for (int32_t x = 0; x < width_; ++x) {
+      field[static_cast<size_t>(y) * width_ + x] = black(x, y) ? BIT_BW : 0;
+    }
+  }
+  for (const la_ant& a : ants_) {
+    if (a.x >= 0 && a.x < width_ && a.y >= 0 && a.y < height_) {
+      field[static_cast<size_t>(a.y) * width_ + a.x] |= a.d;
+    }
+  }
+}
+
+void la_plane_engine::ant_positions(std::vector<la_ant>& positions) const {
+  positions.clear();
+  for (la_ant a : ants_) {
+    if (a.x >= 0 && a.x < width_ && a.y >= 0 && a.y < height_) {
+      a.c = black(a.x, a.y) ? BIT_BW : 0;
+      positions.push_back(a);
+    }
+  }
+}
+
+bool la_plane_engine::bounding_box(int32_t& x0, int32_t& y0,
+                                   int32_t& x1, int32_t& y1) const {
+  bool found = false;
+  for (const auto& kv : chunks_) {
+    const int32_t cx = static_cast<int32_t>(kv.first & 0xffffffff);
+    const int32_t cy = static_cast<int32_t>(kv.first >> 32);
+    const uint64_t* rows = kv.second->rows;
+    uint64_t columns = 0;
+    int32_t first_row = -1;
+    int32_t last_row = -1;
+    for (int32_t r = 0; r < PLANE_CHUNK; ++r) {
+      if (rows[r] != 0) {
+        columns |= rows[r];
+        if (first_row < 0) {
+          first_row = r;
+        }
+        last_row = r;
+      }
+    }
+    if (columns == 0) {
+      continue;
+    }
+    const int32_t cx0 = cx * PLANE_CHUNK + __builtin_ctzll(columns);
+    const int32_t cx1 = cx * PLANE_CHUNK + 63 - __builtin_clzll(columns);
+    const int32_t cy0 = cy * PLANE_CHUNK + first_row;
+    const int32_t cy1 = cy * PLANE_CHUNK + last_row;
+    if (!found) {
+      x0 = cx0;
+      y0 = cy0;
+      x1 = cx1;
+      y1 = cy1;
+      found = true;
+    } else {
+      x0 = std::min(x0, cx0);
+      y0 = std::min(y0, cy0);
+      x1 = std::max(x1, cx1);
+      y1 = std::max(y1, cy1);
+    }
+  }
+  return found;
+}
@@ -0,0 +1,74 @@
+#ifndef LANGTONS_ANT_PLANE_HPP_
+#define LANGTONS_ANT_PLANE_HPP_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include "langtons_ant_cpu.hpp"
+
+// ----------------------------------------------------------------------
+// unbounded engine
+// ----------------------------------------------------------------------
+
+/*
+  Engine on the infinite plane instead of the torus.
+
+  The colours are kept in 64x64 chunks of one bit per square, allocated
+  the first time an ant enters them, so memory grows with the area
+  visited rather than with the field size. Every ant keeps a pointer to
+  the chunk it stands on and only looks up the map when it crosses into
+  another chunk.
+
+  The configured field is a window onto the plane: it gives the initial
+  ants and colours, and read_field and ant_positions return what lies
+  inside it.
+*/
+class la_plane_engine {
+ public:
+  // field holds the colours only; the ants are given separately
+  la_plane_engine(int width, int height, const std::vector<int8_t>& field,
+                  const std::vector<la_ant>& ants);
+
+  // Run n generations.
+  void step(size_t n);
+
+  // Window (0, 0) - (width, height) in the dense layout.
+  void read_field(std::vector<int8_t>& field) const;
+
+  // Ants inside the window, with the current colour of their square in c.
+  void ant_positions(std::vector<la_ant>& positions) const;
+
+  // Number of chunks allocated so far.
+  size_t chunks() const { return chunks_.size(); }
+
+  // Bounding box of the black squares (inclusive), false if none.
+  bool bounding_box(int32_t& x0, int32_t& y0,
+                    int32_t& x1, int32_t& y1) const;
+
+ private:
+  struct chunk {
+    uint64_t rows[64];
+  };
+
+  // chunk under an ant
+  struct cursor {
+    chunk* c;
+    int32_t cx;
+    int32_t cy;
+  };
+
+  static uint64_t key(int32_t cx, int32_t cy);
+  const chunk* find(int32_t cx, int32_t cy) const;
+  chunk* get(int32_t cx, int32_t cy);
+  bool black(int32_t x, int32_t y) const;
+
+  int width_;
+  int height_;
+  std::unordered_map<uint64_t, std::unique_ptr<chunk>> chunks_;
+  std::vector<la_ant> ants_;
+  std::vector<cursor> cursors_;
+};
+
+#endif  // LANGTONS_ANT_PLANE_HPP_